@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "engine.h"
+#include "zobrist.h"
+#include "ai.h"
+
+/*
+ * Global variables
+ */
+
+const ai_weights_t AI_WEIGHTS = { -51, 76, -36, -18 };
+
+/*
+ * Functions
+ */
+
+/* Put a placement's shape on rows and take out the full rows: how many */
+static int land (row_t *rows,const placement_t *placement)
+{
+   const shape_t *shape = &SHAPES[placement->state];
+   int i,y,ny,lines = 0,top = placement->y + shape->top,left = placement->x + shape->left;
+
+   for (i = 0; i < shape->height; i++)
+	 {
+		rows[top + i] |= shape->rowmask[i] << left;
+		if ((rows[top + i] & PLAYFIELD_ROW) == PLAYFIELD_ROW) lines++;
+	 }
+   if (lines == 0) return 0;
+
+   /* only rows the shape is in can have filled up */
+   for (y = ny = top + shape->height - 1; y >= 0; y--)
+	 if ((rows[y] & PLAYFIELD_ROW) != PLAYFIELD_ROW) rows[ny--] = rows[y];
+   for (; ny >= 0; ny--) rows[ny] = WALL_ROW;
+   return lines;
+}
+
+/* Everything but lines */
+static void measure (const row_t *rows,ai_features_t *features)
+{
+   row_t seen = 0,row,fresh;
+   int height[NUMCOLS] = { 0 };
+   int x,y,holes = 0,sum = 0,bumps = 0;
+
+   for (y = 1; y <= PLAYROWS; y++)
+	 {
+		row = rows[y] & PLAYFIELD_ROW;
+		if (!(row | seen)) continue;
+		for (fresh = row & ~seen; fresh; fresh &= fresh - 1) height[lowbit (fresh)] = PLAYROWS + 1 - y;
+		holes += popcount (seen & ~row);
+		seen |= row;
+	 }
+
+   for (x = 1; x <= PLAYCOLS; x++)
+	 {
+		sum += height[x];
+		if (x > 1) bumps += height[x] > height[x - 1] ? height[x] - height[x - 1] : height[x - 1] - height[x];
+	 }
+
+   features->height = sum;
+   features->holes = holes;
+   features->bumpiness = bumps;
+}
+
+void ai_features (const row_t *rows,const placement_t *placement,ai_features_t *features)
+{
+   row_t board[NUMROWS];
+   memcpy (board,rows,sizeof (board));
+   features->lines = land (board,placement);
+   measure (board,features);
+}
+
+int ai_evaluate (const ai_features_t *features,const ai_weights_t *weights)
+{
+   return (features->height * weights->height +
+		   features->lines * weights->lines +
+		   features->holes * weights->holes +
+		   features->bumpiness * weights->bumpiness);
+}
+
+int ai_choose (const engine_t *engine,const ai_weights_t *weights,placement_t *best)
+{
+   placement_t list[MAXREACHABLE];
+   row_t rows[NUMROWS];
+   ai_features_t features;
+   int i,n,value,bestvalue = 0,besti = -1;
+
+   n = engine_reachable (engine,list);
+   engine_rows (engine,rows);
+   for (i = 0; i < n; i++)
+	 {
+		ai_features (rows,&list[i],&features);
+		value = ai_evaluate (&features,weights);
+		if (besti < 0 || value > bestvalue) bestvalue = value, besti = i;
+	 }
+   if (besti >= 0) *best = list[besti];
+   return n;
+}
+
+int ai_search_init (ai_search_t *search,int beam)
+{
+   unsigned int size;
+
+   search->beam = beam;
+   search->maxnodes = MAXREACHABLE * (beam + 1);
+   for (size = 1; size < 2 * (unsigned int) search->maxnodes; size <<= 1)
+	 ;
+   search->nodes = malloc (search->maxnodes * sizeof (ai_node_t));
+   search->best = malloc (MAXREACHABLE * sizeof (ai_node_t *));
+   search->seen = malloc (size * sizeof (uint64_t));
+   search->seenat = calloc (size,sizeof (int));
+   search->seenmask = size - 1;
+   search->serial = 0;
+   search->searches = search->searched = search->usec = 0;
+   if (search->nodes == NULL || search->best == NULL || search->seen == NULL || search->seenat == NULL)
+	 {
+		ai_search_free (search);
+		return ERR;
+	 }
+   zobrist_init ();
+   return OK;
+}
+
+void ai_search_free (ai_search_t *search)
+{
+   free (search->nodes);
+   free (search->best);
+   free (search->seen);
+   free (search->seenat);
+   search->nodes = NULL;
+   search->best = NULL;
+   search->seen = NULL;
+   search->seenat = NULL;
+}
+
+/* Note a board as seen in this search: FALSE if it already was */
+static bool firstsight (ai_search_t *search,uint64_t hash)
+{
+   unsigned int i = (unsigned int) hash & search->seenmask;
+   for (; search->seenat[i] == search->serial; i = (i + 1) & search->seenmask)
+	 if (search->seen[i] == hash) return FALSE;
+   search->seen[i] = hash;
+   search->seenat[i] = search->serial;
+   return TRUE;
+}
+
+/* A node for rows with a placement made, or NULL if that board's been seen */
+static ai_node_t *expand (ai_search_t *search,const ai_weights_t *weights,const row_t *rows,int lines,
+						  const placement_t *placement,int root)
+{
+   ai_node_t *node = &search->nodes[search->numnodes];
+   ai_features_t features;
+
+   memcpy (node->rows,rows,sizeof (node->rows));
+   node->lines = lines + land (node->rows,placement);
+   if (!firstsight (search,zobrist_rows (node->rows))) return NULL;
+   search->numnodes++;
+   measure (node->rows,&features);
+   features.lines = node->lines;
+   node->value = ai_evaluate (&features,weights);
+   node->root = root;
+   return node;
+}
+
+/* Best first, then in the order they were found */
+static int cmpnodes (const void *a,const void *b)
+{
+   const ai_node_t *na = *(const ai_node_t **) a,*nb = *(const ai_node_t **) b;
+   if (na->value != nb->value) return na->value > nb->value ? -1 : 1;
+   return (na > nb) - (na < nb);
+}
+
+int ai_search_part (ai_search_t *search,const engine_t *engine,int depth,int beam,int part,int parts,
+					const ai_weights_t *weights,placement_t *best,int *value)
+{
+   struct timespec start,end;
+   row_t rows[NUMROWS];
+   ai_node_t *node;
+   int numroots,numbest = 0,i,j,n,root = -1;
+
+   clock_gettime (CLOCK_MONOTONIC,&start);
+   search->serial++;
+   search->numnodes = 0;
+   engine_rows (engine,rows);
+   numroots = engine_reachable_from (rows,engine->curstate,engine->curx,engine->cury,search->roots);
+
+   for (i = 0; i < numroots; i++)
+	 {
+		search->rootvalue[i] = INT_MIN;
+		if (i % parts != part) continue;
+		/* placements that leave the same board are as good as the first */
+		if ((node = expand (search,weights,rows,0,&search->roots[i],i)) == NULL) continue;
+		search->rootvalue[i] = node->value;
+		search->best[numbest++] = node;
+	 }
+
+   if (depth > 1 && engine->game_mode != GAME_CHALLENGE)
+	 {
+		qsort (search->best,numbest,sizeof (ai_node_t *),cmpnodes);
+		if (numbest > beam) numbest = beam;
+		/* only the beam competes, even if the next shape won't fit after it */
+		for (i = 0; i < numroots; i++) search->rootvalue[i] = INT_MIN;
+		for (i = 0; i < numbest; i++) search->rootvalue[search->best[i]->root] = INT_MIN + 1;
+		for (i = 0; i < numbest; i++)
+		  {
+			 /* the next shape comes in unrotated at the top (in easytris the column varies) */
+			 n = engine_landings (search->best[i]->rows,engine->nextshape,5,1,search->list);
+			 for (j = 0; j < n; j++)
+			   {
+				  node = expand (search,weights,search->best[i]->rows,search->best[i]->lines,
+								 &search->list[j],search->best[i]->root);
+				  if (node != NULL && node->value > search->rootvalue[node->root])
+					search->rootvalue[node->root] = node->value;
+			   }
+		  }
+	 }
+
+   for (i = part; i < numroots; i += parts)
+	 if (root < 0 || search->rootvalue[i] > search->rootvalue[root]) root = i;
+   if (root >= 0)
+	 {
+		*best = search->roots[root];
+		*value = search->rootvalue[root];
+	 }
+
+   clock_gettime (CLOCK_MONOTONIC,&end);
+   search->searches++;
+   search->searched += search->numnodes;
+   search->usec += (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+   return search->numnodes;
+}
+
+int ai_search (ai_search_t *search,const engine_t *engine,int depth,const ai_weights_t *weights,placement_t *best)
+{
+   int value;
+   return ai_search_part (search,engine,depth,search->beam,0,1,weights,best,&value);
+}
@@ -0,0 +1,176 @@
+#ifndef AI_H
+#define AI_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "engine.h"		/* engine_t, placement_t */
+
+/*
+ * A computer player. It looks at every placement of the falling shape
+ * (see engine_reachable ()), works out what the board would look like
+ * after each one and takes the best, going by a weighted sum of a few
+ * well known features of a tetris board.
+ *
+ * ai_search () does better by looking at the next shape too. It takes
+ * the best few boards the falling shape can leave (the beam), places
+ * the next shape on each of those, and goes for the falling shape's
+ * placement that leads to the best board of all. Boards that turn up
+ * more than once are only weighed once: every board is hashed (see
+ * zobrist.h) into a table of the ones already seen. Its nodes come out
+ * of memory set aside by ai_search_init (), which every search starts
+ * over with, so searching doesn't allocate anything.
+ */
+
+/*
+ * Macros
+ */
+
+/* Boards the search looks further from, unless told otherwise */
+#define AI_BEAM		8
+
+/*
+ * Type definitions
+ */
+
+/* What the board looks like after a placement */
+typedef struct
+{
+   int height;			/* column heights added up */
+   int lines;			/* rows the placement clears */
+   int holes;			/* empty cells with a block above them */
+   int bumpiness;		/* height differences between neighbouring columns, added up */
+} ai_features_t;
+
+/* How much each feature counts, in hundredths */
+typedef ai_features_t ai_weights_t;
+
+/* A board in a search: where some placements leave it */
+typedef struct
+{
+   row_t rows[NUMROWS];
+   int value;			/* ai_evaluate () of it */
+   int lines;			/* rows cleared getting here */
+   int root;			/* the falling shape's placement it came from */
+} ai_node_t;
+
+/* Room for a search, kept from one to the next */
+typedef struct
+{
+   int beam;			/* boards to look further from */
+   ai_node_t *nodes;		/* arena */
+   int numnodes,maxnodes;
+   ai_node_t **best;		/* the beam, best first */
+   uint64_t *seen;		/* hashes of the boards looked at */
+   int *seenat;			/* ... and the search that saw them (older = free slot) */
+   unsigned int seenmask;
+   int serial;			/* this search */
+   placement_t roots[MAXREACHABLE];	/* the falling shape's placements */
+   placement_t list[MAXREACHABLE];	/* and the next shape's */
+   int rootvalue[MAXREACHABLE];
+   long long searches;		/* searches done */
+   long long searched;		/* boards weighed in them */
+   long long usec;		/* time they took */
+} ai_search_t;
+
+/*
+ * Global variables
+ */
+
+/* Weights that clear lines well in every game mode */
+extern const ai_weights_t AI_WEIGHTS;
+
+/*
+ * Functions
+ */
+
+/*
+ * Work out the features of the board rows (as from engine_rows ()) with
+ * the placement made and any full rows cleared.
+ */
+void ai_features (const row_t *rows,const placement_t *placement,ai_features_t *features);
+
+/*
+ * Weigh features: higher is better.
+ */
+int ai_evaluate (const ai_features_t *features,const ai_weights_t *weights);
+
+/*
+ * Find the best placement for the falling shape. Its path may wait for
+ * gravity; see engine_place ().
+ *
+ * OUTPUT:
+ *   how many placements were weighed (0 if there are none; best is
+ *   then left alone)
+ */
+int ai_choose (const engine_t *engine,const ai_weights_t *weights,placement_t *best);
+
+/*
+ * Set aside room for searches that look further from beam boards
+ *
+ * OUTPUT:
+ *   OK, or ERR when out of memory
+ */
+int ai_search_init (ai_search_t *search,int beam);
+
+/*
+ * Free a search's room
+ */
+void ai_search_free (ai_search_t *search);
+
+/*
+ * Find the best placement for the falling shape, looking depth shapes
+ * ahead (1 or 2: the falling one and the next one). Challenge mode
+ * picks the next shape afresh when the falling one lands, so it's
+ * never looked ahead to there.
+ *
+ * OUTPUT:
+ *   how many boards were weighed (0 if the falling shape can't go
+ *   anywhere; best is then left alone)
+ */
+int ai_search (ai_search_t *search,const engine_t *engine,int depth,const ai_weights_t *weights,placement_t *best);
+
+/*
+ * ai_search () over a share of the falling shape's placements (every
+ * parts'th one, from part on), with a beam no wider than the search
+ * was set up for, so parts can be searched side by side. value is what
+ * best leads to: the parts' values can be compared with each other if
+ * they were searched just as deep.
+ *
+ * OUTPUT:
+ *   how many boards were weighed (0 if this part has nowhere to go;
+ *   best and value are then left alone)
+ */
+int ai_search_part (ai_search_t *search,const engine_t *engine,int depth,int beam,int part,int parts,
+					const ai_weights_t *weights,placement_t *best,int *value);
+
+#endif	/* #ifndef AI_H */
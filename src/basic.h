@@ -14,6 +14,9 @@
 #define SHAPE_I    6		/* the red shape */
 #define NO_SHAPE   -9		/* must be negative for rand_value() */
 
+/* Number of distinct orientations of all the shapes (2+2+4+1+4+4+2) */
+#define NUMSTATES	19
+
 /* Number of blocks in each shape */
 #define NUMBLOCKS	4
 
@@ -56,7 +59,13 @@
 #define  SCORE_MAGIC_NUMBER_2	"<notint scorefile version=3>"
 
 /* trad, easy, zen, challenge, and speed */
-#define  SCORE_MAGIC_NUMBER	"<notint scorefile version=4>"
+#define  SCORE_MAGIC_NUMBER_3	"<notint scorefile version=4>"
+
+/* the same, in fixed size little-endian records (see scorefile.h) */
+#define  SCORE_MAGIC_NUMBER	"<notint scorefile version=5>"
+
+/* Header for replay files (see replay.h) */
+#define REPLAY_MAGIC_NUMBER	"<notint replay version=1>"
 
 /* Longer than any "magic number" header in any recognized format,
  * but less than shortest legit score file.
@@ -71,6 +80,13 @@ static const char scoretitle[] = "\n\t NOTINT HIGH SCORES\n\n";
 static const char scorecols[]  = " Game Type   |Rank| Score |New| Name                 | When\n";
 static const char scorebetw[]  = "-------------+----+-------+---+----------------------+-----------\n";
 
+/* Headers for the game history, notint --stats */
+static const char statstitle[] = "\n\t NOTINT GAME HISTORY\n\n";
+static const char statscols[]  = " Game Type   |     Games | Avg score | Avg lines | Avg time | Best score | Most lines | Top level\n";
+static const char statsbetw[]  = "-------------+-----------+-----------+-----------+----------+------------+------------+----------\n";
+static const char trendcols[]  = " Month   | easy-tris | traditional |    zen    | challenge | speed run\n";
+static const char trendbetw[]  = "---------+-----------+-------------+-----------+-----------+-----------\n";
+
 /* Number of scores allowed in highscore list (per mode) */
 #define NUMSCORES 10
 
@@ -150,9 +166,12 @@ static char *gametype[] = {
 #define YTOP ((out_height () - NUMCOLS - 9) >> 1)
 
 /* This calculates the time allowed to move a shape, before it is moved a row down */
-#define DELAY (1000000 / (engine.level + 2))
+#define DELAY (1000000 / (engine->level + 2))
 #define CHALLENGE_DELAY (1000000 / (3))
 
+/* How long to show that a challenge level was cleared */
+#define CLEARED_DELAY 1000000
+
 /* This calculates the stored score value */
 #define SCOREVAL(x) (SCORE_FACTOR * (x))
 
@@ -31,10 +31,12 @@
 
 /* Score file */
 /* Only leading env variables are expanded, so
- *      conf_scorefile[] = "/var/games/notint.scores";  <- okay
- *      conf_scorefile[] = "$NOTINT_SCOREFILE";         <- okay
- *      conf_scorefile[] = "$HOME/my_scores";           <- okay
- *      conf_scorefile[] = "/var/games/$USER/notint";   <- looking for trouble
+ *      conf_scorefile[] = "/var/games/notint/notint.scores";  <- okay
+ *      conf_scorefile[] = "$NOTINT_SCOREFILE";                <- okay
+ *      conf_scorefile[] = "$HOME/my_scores";                  <- okay
+ *      conf_scorefile[] = "/var/games/$USER/notint";          <- looking for trouble
+ * The game must be able to create files in the score file's directory:
+ * new score files are written beside the old one and renamed over it.
  */
 #ifdef SCOREFILE
 char conf_scorefile[] = SCOREFILE;
@@ -42,6 +44,9 @@ char conf_scorefile[] = SCOREFILE;
 char conf_scorefile[] = "$HOME/.notint.scores";
 #endif
 
+/* Every game each player finished, same expansion rules as above */
+char conf_historyfile[] = "$HOME/.notint.history";
+
 /* env var to check for default name for high scores */
 #define NOTINT_NAME  "NOTINT_NAME"
 #endif	/* #ifndef CONFIG_H */
@@ -29,19 +29,32 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <time.h>
 
 #include "typedefs.h"
 #include "utils.h"
-#include "io.h"
+#include "colors.h"
 #include "engine.h"
+#include "score.h"
+#include "zobrist.h"
 
 /*
  * Global variables
  */
 
-const shapes_t SHAPES =
+/*
+ * Every orientation of every shape, with the rotation worked out ahead
+ * of time. Entries 0 .. NUMSHAPES - 1 are the shapes as they first
+ * appear; "next" is the state one press of rotate leads to. The
+ * rotations are the way tetris likes it (= not mathematically correct):
+ * Z turns anti-clockwise then back, S and I clockwise then back, T, L
+ * and J anti-clockwise all the way round, and O not at all.
+ *
+ * Each state also carries its bounding box relative to (x,y) and the
+ * blocks of each box row as a row_t mask, so collision tests are one
+ * AND per row.
+ */
+const shape_t SHAPES[NUMSTATES] =
 {
 /*
  *      X.X       X.X           X.X
@@ -54,93 +67,179 @@ const shapes_t SHAPES =
  * is not the order shown in the tint statistics.)
  */     
 
-   { COLOR_CYAN,    0, FALSE, { {  1,  0 }, {  0,  0 }, {  0, -1 }, { -1, -1 } } },
-   { COLOR_GREEN,   1, FALSE, { {  1, -1 }, {  0, -1 }, {  0,  0 }, { -1,  0 } } },
-   { COLOR_YELLOW,  2, FALSE, { { -1,  0 }, {  0,  0 }, {  1,  0 }, {  0,  1 } } },
-   { COLOR_BLUE,    3, FALSE, { { -1, -1 }, {  0, -1 }, { -1,  0 }, {  0,  0 } } },
-   { COLOR_MAGENTA, 4, FALSE, { { -1,  1 }, { -1,  0 }, {  0,  0 }, {  1,  0 } } },
-   { COLOR_WHITE,   5, FALSE, { {  1,  1 }, {  1,  0 }, {  0,  0 }, { -1,  0 } } },
-   { COLOR_RED,     6, FALSE, { { -1,  0 }, {  0,  0 }, {  1,  0 }, {  2,  0 } } }
-};
+/*   color         type next  blocks                                          left top  w  h  row masks */
+   { COLOR_CYAN,    0,  7, { {  1,  0 }, {  0,  0 }, {  0, -1 }, { -1, -1 } }, -1, -1, 3, 2, { 0x3, 0x6, 0x0, 0x0 } },	/*  0 */
+   { COLOR_GREEN,   1,  8, { {  1, -1 }, {  0, -1 }, {  0,  0 }, { -1,  0 } }, -1, -1, 3, 2, { 0x6, 0x3, 0x0, 0x0 } },	/*  1 */
+   { COLOR_YELLOW,  2,  9, { { -1,  0 }, {  0,  0 }, {  1,  0 }, {  0,  1 } }, -1,  0, 3, 2, { 0x7, 0x2, 0x0, 0x0 } },	/*  2 */
+   { COLOR_BLUE,    3,  3, { { -1, -1 }, {  0, -1 }, { -1,  0 }, {  0,  0 } }, -1, -1, 2, 2, { 0x3, 0x3, 0x0, 0x0 } },	/*  3 */
+   { COLOR_MAGENTA, 4, 12, { { -1,  1 }, { -1,  0 }, {  0,  0 }, {  1,  0 } }, -1,  0, 3, 2, { 0x7, 0x1, 0x0, 0x0 } },	/*  4 */
+   { COLOR_WHITE,   5, 15, { {  1,  1 }, {  1,  0 }, {  0,  0 }, { -1,  0 } }, -1,  0, 3, 2, { 0x7, 0x4, 0x0, 0x0 } },	/*  5 */
+   { COLOR_RED,     6, 18, { { -1,  0 }, {  0,  0 }, {  1,  0 }, {  2,  0 } }, -1,  0, 4, 1, { 0xf, 0x0, 0x0, 0x0 } },	/*  6 */
 
-static board_t blank_board;
+   /* the other orientations, in rotation order */
+   { COLOR_CYAN,    0,  0, { {  0, -1 }, {  0,  0 }, { -1,  0 }, { -1,  1 } }, -1, -1, 2, 3, { 0x2, 0x3, 0x1, 0x0 } },	/*  7 */
+   { COLOR_GREEN,   1,  1, { {  1,  1 }, {  1,  0 }, {  0,  0 }, {  0, -1 } },  0, -1, 2, 3, { 0x1, 0x3, 0x2, 0x0 } },	/*  8 */
+   { COLOR_YELLOW,  2, 10, { {  0,  1 }, {  0,  0 }, {  0, -1 }, {  1,  0 } },  0, -1, 2, 3, { 0x1, 0x3, 0x1, 0x0 } },	/*  9 */
+   { COLOR_YELLOW,  2, 11, { {  1,  0 }, {  0,  0 }, { -1,  0 }, {  0, -1 } }, -1, -1, 3, 2, { 0x2, 0x7, 0x0, 0x0 } },	/* 10 */
+   { COLOR_YELLOW,  2,  2, { {  0, -1 }, {  0,  0 }, {  0,  1 }, { -1,  0 } }, -1, -1, 2, 3, { 0x2, 0x3, 0x2, 0x0 } },	/* 11 */
+   { COLOR_MAGENTA, 4, 13, { {  1,  1 }, {  0,  1 }, {  0,  0 }, {  0, -1 } },  0, -1, 2, 3, { 0x1, 0x1, 0x3, 0x0 } },	/* 12 */
+   { COLOR_MAGENTA, 4, 14, { {  1, -1 }, {  1,  0 }, {  0,  0 }, { -1,  0 } }, -1, -1, 3, 2, { 0x4, 0x7, 0x0, 0x0 } },	/* 13 */
+   { COLOR_MAGENTA, 4,  4, { { -1, -1 }, {  0, -1 }, {  0,  0 }, {  0,  1 } }, -1, -1, 2, 3, { 0x3, 0x2, 0x2, 0x0 } },	/* 14 */
+   { COLOR_WHITE,   5, 16, { {  1, -1 }, {  0, -1 }, {  0,  0 }, {  0,  1 } },  0, -1, 2, 3, { 0x3, 0x1, 0x1, 0x0 } },	/* 15 */
+   { COLOR_WHITE,   5, 17, { { -1, -1 }, { -1,  0 }, {  0,  0 }, {  1,  0 } }, -1, -1, 3, 2, { 0x1, 0x7, 0x0, 0x0 } },	/* 16 */
+   { COLOR_WHITE,   5,  5, { { -1,  1 }, {  0,  1 }, {  0,  0 }, {  0, -1 } }, -1, -1, 2, 3, { 0x2, 0x2, 0x3, 0x0 } },	/* 17 */
+   { COLOR_RED,     6,  6, { {  0, -1 }, {  0,  0 }, {  0,  1 }, {  0,  2 } },  0, -1, 1, 4, { 0x1, 0x1, 0x1, 0x1 } },	/* 18 */
+};
 
 /*
  * Functions
  */
 
-/* This rotates a shape */
-static void real_rotate (shape_t *shape,bool clockwise)
+/* Empty row y of the board (leaving the side walls); the columns and counts are the caller's to fix */
+static void blankrow (board_t *board,int y)
+{
+   board->rows[y] = WALL_ROW;
+   board->chall[y] = 0;
+   memset (board->color[y],0,PLAYCOLS / 2);
+   board->fill[y] = 0;
+}
+
+/* Empty the column planes: wall from top to bottom, and the floor under the rest */
+static void blankcols (board_t *board)
+{
+   int x;
+   for (x = 0; x < NUMCOLS; x++)
+	 board->cols[x] = x >= 1 && x <= PLAYCOLS ? ROWBIT (NUMROWS - 2) | ROWBIT (NUMROWS - 1) : ROWBIT (NUMROWS) - 1;
+}
+
+/* XOR the keys of the play cells set in row y into the board's hash */
+static inline void hashrow (board_t *board,int y,row_t row)
+{
+   for (row &= PLAYFIELD_ROW; row; row &= row - 1) board->hash ^= zobrist_keys[y][lowbit (row)];
+}
+
+/* The keys of a shape's cells, XORed together */
+static uint64_t shapekeys (const shape_t *shape,int x,int y)
 {
-   int i,tmp;
-   if (clockwise)
+   return zobrist_keys[y + shape->block[0].y][x + shape->block[0].x] ^
+	 zobrist_keys[y + shape->block[1].y][x + shape->block[1].x] ^
+	 zobrist_keys[y + shape->block[2].y][x + shape->block[2].x] ^
+	 zobrist_keys[y + shape->block[3].y][x + shape->block[3].x];
+}
+
+/* Reset the board to its empty, walled-in state */
+static void blankboard (board_t *board)
+{
+   int y;
+   blankcols (board);
+   for (y = 0; y < NUMROWS - 2; y++) blankrow (board,y);
+   for (y = NUMROWS - 2; y < NUMROWS; y++)
 	 {
-		for (i = 0; i < NUMBLOCKS; i++)
-		  {
-			 tmp = shape->block[i].x;
-			 shape->block[i].x = -shape->block[i].y;
-			 shape->block[i].y = tmp;
-		  }
+		board->rows[y] = COLBIT (NUMCOLS) - 1;
+		board->chall[y] = 0;
+		board->fill[y] = 0;
 	 }
-   else
+   board->blocks = board->challblocks = 0;
+   board->hash = 0;
+}
+
+/* Set the color of play cell (x,y) */
+static inline void setcolor (board_t *board,int x,int y,int color)
+{
+   unsigned char *cell = &board->color[y][(x - 1) >> 1];
+   int shift = ((x - 1) & 1) << 2;
+   *cell = (*cell & ~(0x0f << shift)) | CELL_PACK (color) << shift;
+}
+
+/* Put a single block on the board */
+static void setblock (board_t *board,int x,int y,int color)
+{
+   if (!(board->rows[y] & COLBIT (x)))
 	 {
-		for (i = 0; i < NUMBLOCKS; i++)
-		  {
-			 tmp = shape->block[i].x;
-			 shape->block[i].x = shape->block[i].y;
-			 shape->block[i].y = -tmp;
-		  }
+		board->rows[y] |= COLBIT (x);
+		board->cols[x] |= ROWBIT (y);
+		board->fill[y]++;
+		board->blocks++;
+		board->hash ^= zobrist_keys[y][x];
 	 }
+   if (board->chall[y] & COLBIT (x)) board->challblocks--;
+   if (color & CHALLENGE_MASK)
+	 {
+		board->chall[y] |= COLBIT (x);
+		board->challblocks++;
+	 }
+   else board->chall[y] &= ~COLBIT (x);
+   setcolor (board,x,y,color);
 }
 
-/* Rotate shapes the way tetris likes it (= not mathematically correct) */
-static void fake_rotate (shape_t *shape)
+/* Bits set in a shape's row mask (no more than 4 wide) */
+static const unsigned char maskbits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+/*
+ * Draw a shape on the board. The counts go by the bits that actually
+ * change, so drawing or erasing a shape that isn't there is harmless.
+ */
+static void drawshape (board_t *board,const shape_t *shape,int x,int y)
 {
-   switch (shape->type)
+   int i,n,left = x + shape->left,top = y + shape->top,blocks = 0,chall = 0;
+   for (i = 0; i < shape->height; i++)
 	 {
-	  case 0:	/* Just rotate this one anti-clockwise and clockwise */
-		if (shape->flipped) real_rotate (shape,TRUE); else real_rotate (shape,FALSE);
-		shape->flipped = !shape->flipped;
-		break;
-	  case 1:	/* Just rotate these two clockwise and anti-clockwise */
-	  case 6:
-		if (shape->flipped) real_rotate (shape,FALSE); else real_rotate (shape,TRUE);
-		shape->flipped = !shape->flipped;
-		break;
-	  case 2:	/* Rotate these three anti-clockwise */
-	  case 4:
-	  case 5:
-		real_rotate (shape,FALSE);
-		break;
-	  case 3:	/* This one is not rotated at all */
-		break;
+		n = maskbits[shape->rowmask[i] & ~(board->rows[top + i] >> left)];
+		board->fill[top + i] += n;
+		blocks += n;
+		chall += maskbits[shape->rowmask[i] & (board->chall[top + i] >> left)];
+		board->rows[top + i] |= shape->rowmask[i] << left;
+		board->chall[top + i] &= ~(shape->rowmask[i] << left);
+	 }
+   board->blocks += blocks;
+   board->challblocks -= chall;
+   for (i = 0; i < NUMBLOCKS; i++)
+	 {
+		setcolor (board,x + shape->block[i].x,y + shape->block[i].y,shape->color);
+		board->cols[x + shape->block[i].x] |= ROWBIT (y + shape->block[i].y);
 	 }
 }
 
-/* Draw a shape on the board */
-static void drawshape (board_t board,shape_t *shape,int x,int y)
+/* Erase a shape from the board */
+static void eraseshape (board_t *board,const shape_t *shape,int x,int y)
 {
-   int i;
-   for (i = 0; i < NUMBLOCKS; i++) board[x + shape->block[i].x][y + shape->block[i].y] = shape->color;
+   int i,n,left = x + shape->left,top = y + shape->top,blocks = 0,chall = 0;
+   for (i = 0; i < shape->height; i++)
+	 {
+		n = maskbits[shape->rowmask[i] & (board->rows[top + i] >> left)];
+		board->fill[top + i] -= n;
+		blocks += n;
+		chall += maskbits[shape->rowmask[i] & (board->chall[top + i] >> left)];
+		board->rows[top + i] &= ~(shape->rowmask[i] << left);
+		board->chall[top + i] &= ~(shape->rowmask[i] << left);
+	 }
+   board->blocks -= blocks;
+   board->challblocks -= chall;
+   for (i = 0; i < NUMBLOCKS; i++)
+	 {
+		setcolor (board,x + shape->block[i].x,y + shape->block[i].y,COLOR_BLACK);
+		board->cols[x + shape->block[i].x] &= ~ROWBIT (y + shape->block[i].y);
+	 }
 }
 
-/* Erase a shape from the board */
-static void eraseshape (board_t board,shape_t *shape,int x,int y)
+/* Check if shape fits in this position, going by the occupied bits alone */
+static bool fits (const row_t *rows,const shape_t *shape,int x,int y)
 {
    int i;
-   for (i = 0; i < NUMBLOCKS; i++) board[x + shape->block[i].x][y + shape->block[i].y] = COLOR_BLACK;
+   y += shape->top;
+   x += shape->left;
+   for (i = 0; i < shape->height; i++) if (rows[y + i] & (shape->rowmask[i] << x)) return FALSE;
+   return TRUE;
 }
 
 /* Check if shape is allowed to be in this position */
-static bool allowed (board_t board,shape_t *shape,int x,int y)
+static bool allowed (board_t *board,const shape_t *shape,int x,int y)
 {
-   int i,occupied = FALSE;
-   for (i = 0; i < NUMBLOCKS; i++) if (board[x + shape->block[i].x][y + shape->block[i].y]) occupied = TRUE;
-   return (!occupied);
+   return fits (board->rows,shape,x,y);
 }
 
 /* Move the shape left if possible */
-static bool shape_left (board_t board,shape_t *shape,int *x,int y)
+static bool shape_left (board_t *board,const shape_t *shape,int *x,int y)
 {
    bool result = FALSE;
    eraseshape (board,shape,*x,y);
@@ -154,7 +253,7 @@ static bool shape_left (board_t board,shape_t *shape,int *x,int y)
 }
 
 /* Move the shape right if possible */
-static bool shape_right (board_t board,shape_t *shape,int *x,int y)
+static bool shape_right (board_t *board,const shape_t *shape,int *x,int y)
 {
    bool result = FALSE;
    eraseshape (board,shape,*x,y);
@@ -168,16 +267,15 @@ static bool shape_right (board_t board,shape_t *shape,int *x,int y)
 }
 
 /* Rotate the shape if possible */
-static bool shape_rotate (board_t board,shape_t *shape,int x,int y)
+static bool shape_rotate (board_t *board,int *state,int x,int y)
 {
    bool result = FALSE;
-   shape_t test;
+   const shape_t *shape = &SHAPES[*state];
    eraseshape (board,shape,x,y);
-   memcpy (&test,shape,sizeof (shape_t));
-   fake_rotate (&test);
-   if (allowed (board,&test,x,y))
+   if (allowed (board,&SHAPES[shape->next],x,y))
 	 {
-		memcpy (shape,&test,sizeof (shape_t));
+		*state = shape->next;
+		shape = &SHAPES[*state];
 		result = TRUE;
 	 }
    drawshape (board,shape,x,y);
@@ -185,7 +283,7 @@ static bool shape_rotate (board_t board,shape_t *shape,int x,int y)
 }
 
 /* Move the shape one row down if possible */
-static bool shape_down (board_t board,shape_t *shape,int x,int *y)
+static bool shape_down (board_t *board,const shape_t *shape,int x,int *y)
 {
    bool result = FALSE;
    eraseshape (board,shape,x,*y);
@@ -200,7 +298,7 @@ static bool shape_down (board_t board,shape_t *shape,int x,int *y)
 
 /* Check if shape can move down (= in the air) or not (= at the bottom */
 /* of the board or on top of one of the resting shapes) */
-static bool shape_bottom (board_t board,shape_t *shape,int x,int y)
+static bool shape_bottom (board_t *board,const shape_t *shape,int x,int y)
 {
    bool result = FALSE;
    eraseshape (board,shape,x,y);
@@ -211,78 +309,230 @@ static bool shape_bottom (board_t board,shape_t *shape,int x,int y)
 
 /* Drop the shape until it comes to rest on the bottom of the board or */
 /* on top of a resting shape */
-static int shape_drop (board_t board,shape_t *shape,int x,int *y)
+static int shape_drop (board_t *board,const shape_t *shape,int x,int *y)
 {
-   int droppedlines = 0;
+   int i,fall,droppedlines = NUMROWS;
    eraseshape (board,shape,x,*y);
-   while (allowed (board,shape,x,*y + 1))
+   /* as far as the nearest block under any of its own (the floor is always there) */
+   for (i = 0; i < NUMBLOCKS; i++)
 	 {
-		(*y)++;
-		droppedlines++;
+		fall = lowbit (board->cols[x + shape->block[i].x] >> (*y + shape->block[i].y + 1));
+		if (fall < droppedlines) droppedlines = fall;
 	 }
+   *y += droppedlines;
    drawshape (board,shape,x,*y);
    return droppedlines;
 }
 
 /* This removes all the rows on the board that is completely filled with blocks */
-static int droplines (board_t board)
+/* Row 0 (off the top) is always emptied, whether anything dropped or not */
+static int droplines (board_t *board)
 {
-   int x,y,ny,status,droppedlines;
-   board_t newboard;
-   /* initialize new board */
-   memcpy (newboard,blank_board,sizeof (board_t));
-   /* ... */
+   column_t gone = 0,col,g;
+   int x,y,ny,droppedlines;
+   board->blocks -= board->fill[0];
+   board->challblocks -= popcount (board->chall[0]);
+   hashrow (board,0,board->rows[0]);
    ny = NUMROWS - 3;
    droppedlines = 0;
    for (y = NUMROWS - 3; y > 0; y--)
 	 {
-		status = 0;
-		for (x = 1; x < NUMCOLS - 2; x++) if (board[x][y]) status++;
-		if (status < NUMCOLS - 3)
+		if (board->fill[y] == PLAYCOLS)
 		  {
-			 for (x = 1; x < NUMCOLS - 2; x++) newboard[x][ny] = board[x][y];
-			 ny--;
+			 gone |= ROWBIT (y);
+			 board->blocks -= PLAYCOLS;
+			 board->challblocks -= popcount (board->chall[y]);
+			 hashrow (board,y,board->rows[y]);
+			 droppedlines++;
+			 continue;
 		  }
-		else droppedlines++;
+		if (ny != y)
+		  {
+			 /* out of the hash at y, in at ny (whatever was at ny is out already) */
+			 hashrow (board,y,board->rows[y]);
+			 hashrow (board,ny,board->rows[y]);
+			 board->rows[ny] = board->rows[y];
+			 board->chall[ny] = board->chall[y];
+			 memcpy (board->color[ny],board->color[y],PLAYCOLS / 2);
+			 board->fill[ny] = board->fill[y];
+		  }
+		ny--;
 	 }
-   memcpy (board,newboard,sizeof (board_t));
+   /* each column loses the same rows (and row 0), and what was above them comes down */
+   if (gone || board->fill[0])
+	 for (x = 1; x <= PLAYCOLS; x++)
+	   {
+		  col = board->cols[x] & ~ROWBIT (0);
+		  for (g = gone; g; g &= g - 1)
+			{
+			   y = lowbit (g);
+			   col = (col & ~(ROWBIT (y + 1) - 1)) | ((col & (ROWBIT (y) - 1)) << 1);
+			}
+		  board->cols[x] = col;
+	   }
+   for (; ny >= 0; ny--) blankrow (board,ny);
    return droppedlines;
 }
 
+/* Inlined even without optimizing, for the lock routines to specialize */
+#ifdef __GNUC__
+#define ALWAYS_INLINE	inline __attribute__ ((always_inline))
+#else
+#define ALWAYS_INLINE	inline
+#endif
+
 /*
- * This counts the blocks on the board after applying a bitmask
- * eg CHALLENGE_MASK finds only challenge blocks.
+ * A shape has come to rest: score it, clear lines and bring in the next
+ * one. Called with a constant mode and score function (see LOCK ()), it
+ * turns into a routine for that mode alone, with no tests for the
+ * others and the scoring rules inline.
+ *
+ * OUTPUT:
+ *   0 = next shape released
+ *  -1 = game over (board full)
  */
-static int countblocks (int mask, board_t board)
-{
-   int r, c, count = 0;
-   /* row[0] empty (off top);
-    * row[NUMROWS-1] and row[NUMROWS-2] bottom wall;
-    * col[0] left wall; col[NUMCOLS-1], and col[NUMCOLS-2] right wall
-    */
-   for (r = 1; r < NUMROWS - 2; r++) {
-	for (c = 1; c < NUMCOLS - 2; c++) {
-		if (mask & board[c][r])
-			count ++;
-	}
+static ALWAYS_INLINE int lockshape (engine_t *engine,int mode,void (*score)(engine_t *))
+{
+   int need_reset = FALSE;
+
+   /* the shape is part of the board from now on */
+   engine->board.hash ^= shapekeys (&SHAPES[engine->curstate],engine->curx,engine->cury);
+
+   /* collect data to increase score */
+   engine->status.lastclear = droplines (&engine->board);
+
+   /* count blocks only if we actually cleared something */
+   if ((mode == GAME_CHALLENGE) &&
+	   (engine->status.lastclear > 0))
+	 {
+		engine->status.challengeblocks = engine->board.challblocks;
+		engine->status.nonchallengeblocks = engine->board.blocks - engine->status.challengeblocks;
+		if(engine->status.challengeblocks < 1)
+		  {
+			 /* level may effect score, just collect data now, then
+			  * score, then up level and reset
+			  */
+			 need_reset = TRUE;
+			 engine->level_cleared = TRUE;
+		  }
+	 }
+
+   score (engine);
+
+   if (need_reset)
+	 {
+		blankboard (&engine->board);
+		engine->level ++;
+		engine_chalset (engine);
+	 }
+
+   if ((mode == GAME_CHALLENGE) &&
+	   (engine->status.lastclear == 0))
+	 {
+		engine->status.nonchallengeblocks += NUMBLOCKS;
+	 }
+
+   /* update status information */
+   engine->status.droppedlines += engine->status.lastclear;
+   engine->status.lastclear = 0;
+   engine->curx -= 5;
+   engine->curx = abs (engine->curx);
+   engine->status.rotations = 4 - engine->status.rotations;
+   engine->status.rotations = engine->status.rotations > 0 ? 0 : engine->status.rotations;
+   engine->status.efficiency += engine->status.dropcount + engine->status.rotations + (engine->curx - engine->status.moves);
+   engine->status.efficiency >>= 1;
+   engine->status.dropcount = engine->status.rotations = engine->status.moves = 0;
+   /* intialize values */
+   if(mode == GAME_EASYTRIS) {
+	  /* go wild */
+	  engine->curx = 4+rand_value(&engine->rng,-1,5);
+   } else {
+	  engine->curx = 5;
    }
-   return count;
+   engine->cury = 1;
+   engine->curshape = engine->nextshape;
+
+   if (mode == GAME_CHALLENGE) {
+	  engine->curshape = rand_value(&engine->rng, engine->prefer_shape, NUMSHAPES);
+	  engine->nextshape = rand_value(&engine->rng, engine->prefer_shape, NUMSHAPES);
+   } else {
+	  engine->nextshape = rand_value (&engine->rng, engine->rand_status, NUMSHAPES);
+	  engine->rand_status = update_rs(&engine->rng, engine->rand_status);
+   }
+   engine->curstate = engine->curshape;
+
+   /* return games status */
+   return allowed (&engine->board,&SHAPES[engine->curstate],engine->curx,engine->cury) ? 0 : -1;
+}
+
+/*
+ * The lock routines for a mode: one with its score_standard () rules
+ * built in, and one calling the engine's own score function
+ */
+#define LOCK(name,mode,rules) \
+static int name (engine_t *engine) { return lockshape (engine,mode,rules); } \
+static int name##_own (engine_t *engine) { return lockshape (engine,mode,engine->score_function); }
+
+LOCK (lock_easytris,GAME_EASYTRIS,score_easytris)
+LOCK (lock_traditional,GAME_TRADITIONAL,score_traditional)
+LOCK (lock_zen,GAME_ZEN,score_zen)
+LOCK (lock_challenge,GAME_CHALLENGE,score_challenge)
+LOCK (lock_speed,GAME_SPEED,score_speed)
+
+/* Any other mode, tested for as it goes */
+static int lock_any (engine_t *engine)
+{
+   return lockshape (engine,engine->game_mode,engine->score_function);
+}
+
+/* By engine->lock: each mode with the standard rules, then with its own, then any */
+#define LOCK_OWN	GAME_MODE_COUNT
+#define LOCK_ANY	(2 * GAME_MODE_COUNT)
+static int (*const locks[LOCK_ANY + 1])(engine_t *) =
+{
+   [GAME_EASYTRIS] = lock_easytris,
+   [GAME_TRADITIONAL] = lock_traditional,
+   [GAME_ZEN] = lock_zen,
+   [GAME_CHALLENGE] = lock_challenge,
+   [GAME_SPEED] = lock_speed,
+   [LOCK_OWN + GAME_EASYTRIS] = lock_easytris_own,
+   [LOCK_OWN + GAME_TRADITIONAL] = lock_traditional_own,
+   [LOCK_OWN + GAME_ZEN] = lock_zen_own,
+   [LOCK_OWN + GAME_CHALLENGE] = lock_challenge_own,
+   [LOCK_OWN + GAME_SPEED] = lock_speed_own,
+   [LOCK_ANY] = lock_any
+};
+
+/* Pick the lock routine for the engine's mode and score function */
+static void setlock (engine_t *engine)
+{
+   if (engine->game_mode < MODE_LOW || engine->game_mode > MODE_HIGH) engine->lock = LOCK_ANY;
+   else if (engine->score_function == score_standard) engine->lock = engine->game_mode;
+   else engine->lock = LOCK_OWN + engine->game_mode;
 }
 
 /*
  * Initialize specified tetris engine
  */
-void engine_init (engine_t *engine,void (*score_function)(engine_t *))
+void engine_init (engine_t *engine,void (*score_function)(engine_t *),uint64_t seed)
 {
-   int i;
+   zobrist_init ();
    engine->score_function = score_function;
+   engine->seed = seed;
+   rng_seed (&engine->rng,seed);
    /* intialize values */
    engine->curx = 5;
    engine->cury = 1;
-   engine->curshape = rand_value (-1, NUMSHAPES);
-   engine->nextshape = rand_value (-1, NUMSHAPES);
+   engine->curshape = rand_value (&engine->rng, -1, NUMSHAPES);
+   engine->nextshape = rand_value (&engine->rng, -1, NUMSHAPES);
+   engine->curstate = engine->curshape;
    engine->prefer_shape = NO_SHAPE;
    engine->game_mode = GAME_TRADITIONAL;
+   setlock (engine);
+   engine->shownext = engine->dottedlines = FALSE;
+   engine->headless = FALSE;
+   engine->level_cleared = FALSE;
+   engine->clock_usec = 0;
    engine->score = 0;
    engine->rand_status = -1;
    engine->status.moves =
@@ -296,16 +546,8 @@ void engine_init (engine_t *engine,void (*score_function)(engine_t *))
 	engine->status.challengeblocks_prev =
         engine->status.nonchallengeblocks =
 		0;
-   /* initialize shapes */
-   memcpy (engine->shapes,SHAPES,sizeof (shapes_t));
-
    /* initialize board */
-   memset (engine->board,0,sizeof (board_t));
-   for (i = 0; i < NUMCOLS; i++) engine->board[i][NUMROWS - 1] = engine->board[i][NUMROWS - 2] = WALL;
-   for (i = 0; i < NUMROWS; i++) engine->board[0][i] = engine->board[NUMCOLS - 1][i] = engine->board[NUMCOLS - 2][i] = WALL;
-   
-   /* and save a copy for resets */
-   memcpy (blank_board,engine->board,sizeof (board_t));
+   blankboard (&engine->board);
 /*
  * There's a double wall at the right and bottom:
  *
@@ -337,10 +579,10 @@ void engine_init (engine_t *engine,void (*score_function)(engine_t *))
  *
  * AND the top row (0) is off the screen.
  *
- *  engine->board[ 1][01]  = 2  left top corner
- *  engine->board[10][01]  = 3  right top corner
- *  engine->board[ 1][20]  = 4  left bottom corner
- *  engine->board[10][20]  = 5  right bottom corner
+ *  BOARD_CELL (&engine->board, 1,01)  = 2  left top corner
+ *  BOARD_CELL (&engine->board,10,01)  = 3  right top corner
+ *  BOARD_CELL (&engine->board, 1,20)  = 4  left bottom corner
+ *  BOARD_CELL (&engine->board,10,20)  = 5  right bottom corner
  */
 }
 
@@ -351,6 +593,8 @@ void engine_tweak (int level, int mode, engine_t *engine)
 {
      engine->level = level;
      engine->game_mode = mode;
+     /* from now on every landing goes straight to this mode's rules */
+     setlock (engine);
      engine->start_time = time(NULL);
      engine->pause_start = engine->pause_end = engine->accumulated_pause =
 	 (time_t)0;
@@ -358,6 +602,10 @@ void engine_tweak (int level, int mode, engine_t *engine)
      if (engine->game_mode == GAME_CHALLENGE) 
         {
 	    engine_chalset (engine);
+	    /* for scoring purposes, don't give them extra levels worth
+	     * of "free" lines to clear.
+	     */
+	    engine->status.droppedlines = 10 * (engine->level - 1);
 	    return;
         }
 
@@ -370,16 +618,16 @@ void engine_tweak (int level, int mode, engine_t *engine)
       * shape from being first.
       */
      engine->rand_status = ((level - 1) % NUMSHAPES) << STATUS_SHIFT;
-     engine->rand_status = update_rs(engine->rand_status);
+     engine->rand_status = update_rs(&engine->rng, engine->rand_status);
 
       /*
        * Pick first two pieces according to the easy-tris rules,
        * replacing the engine_init choices.
       */
-     engine->curshape = rand_value(engine->rand_status, NUMSHAPES);
-     engine->rand_status = update_rs(engine->rand_status);
-     engine->nextshape = rand_value(engine->rand_status, NUMSHAPES);
-     engine->rand_status = update_rs(engine->rand_status);
+     engine->curshape = engine->curstate = rand_value(&engine->rng, engine->rand_status, NUMSHAPES);
+     engine->rand_status = update_rs(&engine->rng, engine->rand_status);
+     engine->nextshape = rand_value(&engine->rng, engine->rand_status, NUMSHAPES);
+     engine->rand_status = update_rs(&engine->rng, engine->rand_status);
 }
 
 /*
@@ -393,6 +641,7 @@ void engine_chalset (engine_t *engine)
 {
    int r, c;	/* row and column */
    int h,i,j,k;   /* misc use */
+   uint32_t draw[21];  /* random numbers for one row */
 
    engine->prefer_shape = NO_SHAPE;
    engine->show_special = 0;
@@ -412,7 +661,7 @@ void engine_chalset (engine_t *engine)
 		      for (r = 12 + c; r < 21; r++)
 		         {
 			      i = ((j == (r % k)) || (j == (c % k)));
-			      if (i) engine->board[c][r] = (CHALLENGE_MASK | c);
+			      if (i) setblock (&engine->board,c,r,CHALLENGE_MASK | c);
 		         }
 		    }
 	         break;
@@ -441,7 +690,7 @@ void engine_chalset (engine_t *engine)
 		      for (r = 18 - h; r < 21; r++)
 		      {
 		        k = (r + c) % 7 + 1;  /* color */
-			if(0 == (c % j)) engine->board[c][r] = (CHALLENGE_MASK | k);
+			if(0 == (c % j)) setblock (&engine->board,c,r,CHALLENGE_MASK | k);
 		      }
 		    }
 
@@ -468,7 +717,7 @@ void engine_chalset (engine_t *engine)
 		         {
 			      k = (r % 7) + 1; /* color by row */
 			      i = (c + r) % 2;
-			      if (i) engine->board[c][r] = (CHALLENGE_MASK | k);
+			      if (i) setblock (&engine->board,c,r,CHALLENGE_MASK | k);
 		         }
 		    }
 	         break;
@@ -487,7 +736,7 @@ void engine_chalset (engine_t *engine)
 		      for (r = 12 + h; r < 21; r++)
 		         {
 			      k = 1 + (r % 7); /* color */
-			      if (j == (c+r) %2) engine->board[c][r] = (CHALLENGE_MASK | k);
+			      if (j == (c+r) %2) setblock (&engine->board,c,r,CHALLENGE_MASK | k);
 		         }
 		    }
 	         break;
@@ -505,16 +754,20 @@ void engine_chalset (engine_t *engine)
 
 	       for (r = h; r < 21; r++)
 		  {
+		    /* all the draws this row could need, in one go:
+		     * [0] first color, [c] block at c?, [10 + c] color after c
+		     */
+		    rng_fill (&engine->rng, draw, 21);
 		    i = 0;                      /* block count in row */
-		    j = 1 + rand_value(-1, 7);  /* current color */
+		    j = 1 + RNG_RANGE(draw[0], 7);  /* current color */
 		    for (c = 1; c < 11; c++)
 		       {
-			    if (k > rand_value (-1, 99)) {
+			    if (k > RNG_RANGE(draw[c], 99)) {
 			        i ++; 
 				if (i < 6) {
-				   engine->board[c][r] = (CHALLENGE_MASK | j);
+				   setblock (&engine->board,c,r,CHALLENGE_MASK | j);
 
-		                   if (i > 3) { j = 1 + rand_value(-1, 7); }  /* new color */
+		                   if (i > 3) { j = 1 + RNG_RANGE(draw[10 + c], 7); }  /* new color */
 			        } else {
 				   /* ensure at least one blank */
 				   i = 0;
@@ -527,7 +780,40 @@ void engine_chalset (engine_t *engine)
    engine->status.challengestart =
 	engine->status.challengeblocks =
 	engine->status.challengeblocks_prev =
-		countblocks (CHALLENGE_MASK, engine->board);
+		engine->board.challblocks;
+}
+
+/*
+ * Time allowed to move a shape before it drops a row, in microseconds
+ */
+int engine_delay (const engine_t *engine)
+{
+   if (engine->game_mode == GAME_CHALLENGE) return CHALLENGE_DELAY;
+   return 1000000 / (engine->level + 2);
+}
+
+/*
+ * Seconds of play so far
+ */
+time_t engine_runtime (const engine_t *engine)
+{
+   return (time_t) (engine->clock_usec / 1000000);
+}
+
+/*
+ * Go up a level if enough lines have been cleared
+ */
+bool engine_levelcheck (engine_t *engine)
+{
+   if ((engine->level < MAXLEVEL) &&
+       ((engine->status.droppedlines / 10) > engine->level) &&
+       (engine->game_mode != GAME_CHALLENGE) &&
+       (engine->game_mode != GAME_ZEN))
+	 {
+		engine->level++;
+		return TRUE;
+	 }
+   return FALSE;
 }
 
 /*
@@ -539,19 +825,19 @@ void engine_move (engine_t *engine,action_t action)
 	 {
 		/* move shape to the left if possible */
 	  case ACTION_LEFT:
-		if (shape_left (engine->board,&engine->shapes[engine->curshape],&engine->curx,engine->cury)) engine->status.moves++;
+		if (shape_left (&engine->board,&SHAPES[engine->curstate],&engine->curx,engine->cury)) engine->status.moves++;
 		break;
 		/* rotate shape if possible */
 	  case ACTION_ROTATE:
-		if (shape_rotate (engine->board,&engine->shapes[engine->curshape],engine->curx,engine->cury)) engine->status.rotations++;
+		if (shape_rotate (&engine->board,&engine->curstate,engine->curx,engine->cury)) engine->status.rotations++;
 		break;
 		/* move shape to the right if possible */
 	  case ACTION_RIGHT:
-		if (shape_right (engine->board,&engine->shapes[engine->curshape],&engine->curx,engine->cury)) engine->status.moves++;
+		if (shape_right (&engine->board,&SHAPES[engine->curstate],&engine->curx,engine->cury)) engine->status.moves++;
 		break;
 		/* drop shape to the bottom */
 	  case ACTION_DROP:
-		engine->status.dropcount += shape_drop (engine->board,&engine->shapes[engine->curshape],engine->curx,&engine->cury);
+		engine->status.dropcount += shape_drop (&engine->board,&SHAPES[engine->curstate],engine->curx,&engine->cury);
 	 }
 }
 
@@ -566,78 +852,404 @@ void engine_move (engine_t *engine,action_t action)
  */
 int engine_evaluate (engine_t *engine)
 {
-   int need_reset = FALSE;
+   if (shape_bottom (&engine->board,&SHAPES[engine->curstate],engine->curx,engine->cury))
+	 return locks[engine->lock] (engine);
+   shape_down (&engine->board,&SHAPES[engine->curstate],engine->curx,&engine->cury);
+   return 1;
+}
+
+/* A snapshot's flags */
+#define SNAP_SHOWNEXT		0x01
+#define SNAP_DOTTEDLINES	0x02
+#define SNAP_HEADLESS		0x04
+#define SNAP_CLEARED		0x08
+
+/*
+ * Pack the game into a snapshot
+ */
+void engine_snapshot (const engine_t *engine,engine_snapshot_t *snapshot)
+{
+   snapshot->seed = engine->seed;
+   snapshot->rng = engine->rng.state;
+   snapshot->clock_usec = engine->clock_usec;
+   snapshot->accumulated_pause = engine->accumulated_pause;
+   snapshot->status = engine->status;
+   snapshot->level = engine->level;
+   snapshot->score = engine->score;
+   snapshot->rand_status = engine->rand_status;
+   snapshot->curx = engine->curx;
+   snapshot->cury = engine->cury;
+   snapshot->curshape = engine->curshape;
+   snapshot->nextshape = engine->nextshape;
+   snapshot->curstate = engine->curstate;
+   snapshot->prefer_shape = engine->prefer_shape;
+   snapshot->show_special = engine->show_special;
+   snapshot->game_mode = engine->game_mode;
+   snapshot->flags = (engine->shownext ? SNAP_SHOWNEXT : 0) |
+	 (engine->dottedlines ? SNAP_DOTTEDLINES : 0) |
+	 (engine->headless ? SNAP_HEADLESS : 0) |
+	 (engine->level_cleared ? SNAP_CLEARED : 0);
+
+   memcpy (snapshot->cells,engine->board.color,sizeof (snapshot->cells));
+   memset (snapshot->rows,0,sizeof (snapshot->rows));
+   memset (snapshot->chall,0,sizeof (snapshot->chall));
+   memcpy (snapshot->rows,engine->board.rows,(PLAYROWS + 1) * sizeof (row_t));
+   memcpy (snapshot->chall,engine->board.chall,(PLAYROWS + 1) * sizeof (row_t));
+   snapshot->hash = engine->board.hash;
+}
+
+/*
+ * engine_restore () works out the columns and counts eight rows at a
+ * time, from the rows packed as two planes of bytes: byte n of a plane
+ * is row n, columns 0 .. 7 in the first plane and the rest in the
+ * second.
+ */
+
+/* The lowest bit of each byte */
+#define BYTES	0x0101010101010101ULL
+
+/* Times the lowest bit of each byte, puts the eight of them together in the top byte */
+#define GATHER8	0x0102040810204080ULL
+
+/* Bytes 0, 2, 4 and 6 of v, side by side in the low 32 bits */
+static inline uint64_t evenbytes (uint64_t v)
+{
+   v &= 0x00ff00ff00ff00ffULL;
+   v = (v | v >> 8) & 0x0000ffff0000ffffULL;
+   return (v | v >> 16) & 0xffffffffULL;
+}
+
+/* Eight rows into the two planes */
+static inline void pack8 (const row_t *rows,uint64_t *lo,uint64_t *hi)
+{
+   uint64_t a = rows[0] | (uint64_t) rows[1] << 16 | (uint64_t) rows[2] << 32 | (uint64_t) rows[3] << 48;
+   uint64_t b = rows[4] | (uint64_t) rows[5] << 16 | (uint64_t) rows[6] << 32 | (uint64_t) rows[7] << 48;
+   *lo = evenbytes (a) | evenbytes (b) << 32;
+   *hi = evenbytes (a >> 8) | evenbytes (b >> 8) << 32;
+}
+
+/* The bits set in each byte, in that byte */
+static inline uint64_t bytecount (uint64_t v)
+{
+   v -= (v >> 1) & 0x5555555555555555ULL;
+   v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+   return (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+}
+
+/*
+ * Put a game back the way it was at engine_snapshot ()
+ */
+void engine_restore (engine_t *engine,const engine_snapshot_t *snapshot)
+{
+   board_t *board = &engine->board;
+   uint64_t planes[2][SNAPSHOT_ROWS / 8],lo,hi,count;
+   unsigned char fill[SNAPSHOT_ROWS];
+   column_t col;
+   int x,y,n,blocks = 0,challblocks = 0;
+
+   engine->seed = snapshot->seed;
+   engine->rng.state = snapshot->rng;
+   engine->clock_usec = snapshot->clock_usec;
+   engine->accumulated_pause = snapshot->accumulated_pause;
+   engine->status = snapshot->status;
+   engine->level = snapshot->level;
+   engine->score = snapshot->score;
+   engine->rand_status = snapshot->rand_status;
+   engine->curx = snapshot->curx;
+   engine->cury = snapshot->cury;
+   engine->curshape = snapshot->curshape;
+   engine->nextshape = snapshot->nextshape;
+   engine->curstate = snapshot->curstate;
+   engine->prefer_shape = snapshot->prefer_shape;
+   engine->show_special = snapshot->show_special;
+   engine->game_mode = snapshot->game_mode;
+   setlock (engine);
+   engine->shownext = (snapshot->flags & SNAP_SHOWNEXT) != 0;
+   engine->dottedlines = (snapshot->flags & SNAP_DOTTEDLINES) != 0;
+   engine->headless = (snapshot->flags & SNAP_HEADLESS) != 0;
+   engine->level_cleared = (snapshot->flags & SNAP_CLEARED) != 0;
 
-   if (shape_bottom (engine->board,&engine->shapes[engine->curshape],engine->curx,engine->cury))
+   /*
+	* the planes as they were, and the columns and counts from the rows
+	* (the walls and the floor under them are there from engine_init ())
+	*/
+   memcpy (board->color,snapshot->cells,sizeof (snapshot->cells));
+   memcpy (board->rows,snapshot->rows,(PLAYROWS + 1) * sizeof (row_t));
+   memcpy (board->chall,snapshot->chall,(PLAYROWS + 1) * sizeof (row_t));
+   board->hash = snapshot->hash;
+   for (y = 0; y < SNAPSHOT_ROWS; y += 8)
 	 {
-		/* collect data to increase score */
-		engine->status.lastclear = droplines (engine->board);
-		
-		/* count blocks only if we actually cleared something */
-                if ((engine->game_mode == GAME_CHALLENGE) &&
-		    (engine->status.lastclear > 0))
-                    {
-			engine->status.challengeblocks = countblocks (CHALLENGE_MASK, engine->board);
-			engine->status.nonchallengeblocks = countblocks ( COLOR_MASK, engine->board) - engine->status.challengeblocks; 
-			if(engine->status.challengeblocks < 1)
-			    {
-				/* level may effect score, just collect data now, then
-				 * score, then up level and reset
-				 */
-				need_reset = TRUE;
-				sleep(1);
-			    }
-		    }
+		pack8 (snapshot->rows + y,&lo,&hi);
+		planes[0][y >> 3] = lo &= (PLAYFIELD_ROW & 0xff) * BYTES;
+		planes[1][y >> 3] = hi &= (PLAYFIELD_ROW >> 8) * BYTES;
+		count = bytecount (lo) + bytecount (hi);
+		for (n = 0; n < 8; n++) fill[y + n] = count >> (n << 3);
+		blocks += (count * BYTES) >> 56;
+		pack8 (snapshot->chall + y,&lo,&hi);
+		challblocks += ((bytecount (lo) + bytecount (hi)) * BYTES) >> 56;
+	 }
+   memcpy (board->fill,fill,PLAYROWS + 1);
+   for (x = 1; x <= PLAYCOLS; x++)
+	 {
+		col = ROWBIT (NUMROWS - 2) | ROWBIT (NUMROWS - 1);
+		for (y = 0; y < SNAPSHOT_ROWS; y += 8)
+		  col |= (column_t) ((((planes[x >> 3][y >> 3] >> (x & 7)) & BYTES) * GATHER8) >> 56) << y;
+		board->cols[x] = col;
+	 }
+   board->blocks = blocks;
+   board->challblocks = challblocks;
+}
 
-		engine->score_function (engine);
+/*
+ * The board's hash, and the keys of the rest
+ */
+uint64_t engine_hash (const engine_t *engine)
+{
+   return engine->board.hash ^
+	 shapekeys (&SHAPES[engine->curstate],engine->curx,engine->cury) ^
+	 zobrist_curshape[engine->curshape] ^
+	 zobrist_nextshape[engine->nextshape] ^
+	 zobrist_status (engine->rand_status);
+}
 
-		if (need_reset)
-		    {
-			memcpy (engine->board,blank_board,sizeof (board_t));
-			engine->level ++;
-	                engine_chalset (engine);
-		    }
-		
-                if ((engine->game_mode == GAME_CHALLENGE) &&
-		    (engine->status.lastclear == 0))
-		    {
-			engine->status.nonchallengeblocks += NUMBLOCKS;
-		    }
+/*
+ * The settled blocks, without the falling shape
+ */
+void engine_rows (const engine_t *engine,row_t rows[NUMROWS])
+{
+   const shape_t *shape = &SHAPES[engine->curstate];
+   int i,top = engine->cury + shape->top;
+   memcpy (rows,engine->board.rows,NUMROWS * sizeof (row_t));
+   for (i = 0; i < shape->height; i++) rows[top + i] &= ~(shape->rowmask[i] << (engine->curx + shape->left));
+}
 
-		/* update status information */
-		engine->status.droppedlines += engine->status.lastclear;
-                engine->status.lastclear = 0;
-		engine->curx -= 5;
-		engine->curx = abs (engine->curx);
-		engine->status.rotations = 4 - engine->status.rotations;
-		engine->status.rotations = engine->status.rotations > 0 ? 0 : engine->status.rotations;
-		engine->status.efficiency += engine->status.dropcount + engine->status.rotations + (engine->curx - engine->status.moves);
-		engine->status.efficiency >>= 1;
-		engine->status.dropcount = engine->status.rotations = engine->status.moves = 0;
-		/* intialize values */
-		if(engine->game_mode == GAME_EASYTRIS) {
-			/* go wild */
-			engine->curx = 4+rand_value(-1,5);
-		} else {
-			engine->curx = 5;
-		}
-		engine->cury = 1;
-		engine->curshape = engine->nextshape;
-
-                if (engine->game_mode == GAME_CHALLENGE) {
-		   engine->curshape = rand_value(engine->prefer_shape, NUMSHAPES);
-		   engine->nextshape = rand_value(engine->prefer_shape, NUMSHAPES);
-	        } else {
-		   engine->nextshape = rand_value (engine->rand_status, NUMSHAPES);
-		   engine->rand_status = update_rs(engine->rand_status);
-		}
-
-		/* initialize shapes */
-		memcpy (engine->shapes,SHAPES,sizeof (shapes_t));
-		/* return games status */
-		return allowed (engine->board,&engine->shapes[engine->curshape],engine->curx,engine->cury) ? 0 : -1;
+/* Add a step to a placement's path */
+#define STEP(p,action)	((p)->path[(p)->length++] = (action))
+
+/*
+ * Every place the falling shape can be dropped into: rotate it where
+ * it is, slide it as far as it goes either way, and drop it.
+ */
+int engine_placements (const engine_t *engine,placement_t *list)
+{
+   row_t rows[NUMROWS];
+   const shape_t *shape;
+   placement_t *p;
+   int state = engine->curstate,rotations,dir,shift,x,y,i,count = 0;
+
+   engine_rows (engine,rows);
+   for (rotations = 0; rotations < 4; rotations++)
+	 {
+		if (rotations > 0)
+		  {
+			 /* all the way round, or stuck */
+			 if (SHAPES[state].next == engine->curstate ||
+				 !fits (rows,&SHAPES[SHAPES[state].next],engine->curx,engine->cury))
+			   break;
+			 state = SHAPES[state].next;
+		  }
+		shape = &SHAPES[state];
+		/* the left pass takes the column it's in */
+		for (dir = -1; dir <= 1; dir += 2)
+		  for (x = engine->curx, shift = 0; fits (rows,shape,x,engine->cury); x += dir, shift++)
+			{
+			   if (dir > 0 && shift == 0) continue;
+			   for (y = engine->cury; fits (rows,shape,x,y + 1); y++)
+				 ;
+			   p = &list[count++];
+			   p->state = state;
+			   p->x = x;
+			   p->y = y;
+			   p->length = 0;
+			   for (i = 0; i < rotations; i++) STEP (p,ACTION_ROTATE);
+			   for (i = 0; i < shift; i++) STEP (p,dir < 0 ? ACTION_LEFT : ACTION_RIGHT);
+			   STEP (p,ACTION_DROP);
+			}
 	 }
-   shape_down (engine->board,&engine->shapes[engine->curshape],engine->curx,&engine->cury);
-   return 1;
+   return count;
+}
+
+/* A shape position in engine_reachable (), and how it was got to */
+typedef struct
+{
+   unsigned char rotation,x,y;	/* rotations from the current state */
+   unsigned char length;	/* moves it takes */
+   unsigned char action;	/* the last of them */
+   short from;			/* queue index of the position before */
+} position_t;
+
+/*
+ * Breadth first search over (rotation,x,y), so the first path found to
+ * a position is a shortest one. Where the shape fits and where it has
+ * been are both one bit per position, a row of x bits for every
+ * rotation and y: a few cache lines each.
+ */
+typedef struct
+{
+   row_t fit[4][NUMROWS];
+   row_t visited[4][NUMROWS];
+   int states[4];
+   position_t queue[4 * NUMCOLS * NUMROWS];
+   int tail;
+} search_t;
+
+/* Does the shape fit here? */
+#define FITS(search,rotation,x,y) ((search)->fit[rotation][y] & COLBIT (x))
+
+/*
+ * Work out every x the shape fits at on row y all at once: a block at
+ * dx is in the way of x wherever the row it's on has column x + dx
+ */
+static row_t fitrow (const row_t *rows,const shape_t *shape,int y)
+{
+   unsigned int blocked = 0,row;
+   int i;
+   if (y + shape->top < 0 || y + shape->top + shape->height > NUMROWS) return 0;
+   for (i = 0; i < NUMBLOCKS; i++)
+	 {
+		row = rows[y + shape->block[i].y];
+		blocked |= shape->block[i].x < 0 ? row << -shape->block[i].x : row >> shape->block[i].x;
+	 }
+   return ~blocked & PLAYFIELD_ROW;
+}
+
+/* Queue a position if the shape fits there and it's new */
+static void visit (search_t *search,int from,int rotation,int x,int y,int action)
+{
+   position_t *p;
+   if ((search->visited[rotation][y] & COLBIT (x)) || !FITS (search,rotation,x,y))
+	 return;
+   search->visited[rotation][y] |= COLBIT (x);
+   p = &search->queue[search->tail++];
+   p->rotation = rotation;
+   p->x = x;
+   p->y = y;
+   p->length = from < 0 ? 0 : search->queue[from].length + 1;
+   p->action = action;
+   p->from = from;
+}
+
+int engine_reachable_from (const row_t rows[NUMROWS],int state,int x,int y,placement_t *list)
+{
+   search_t search;
+   const position_t *pos,*p;
+   placement_t *placement;
+   int numstates = 1,head,count = 0,r,row;
+
+   memset (search.visited,0,sizeof (search.visited));
+   search.states[0] = state;
+   while (numstates < 4 && SHAPES[search.states[numstates - 1]].next != state)
+	 {
+		search.states[numstates] = SHAPES[search.states[numstates - 1]].next;
+		numstates++;
+	 }
+   for (r = 0; r < numstates; r++)
+	 for (row = 0; row < NUMROWS; row++)
+	   search.fit[r][row] = fitrow (rows,&SHAPES[search.states[r]],row);
+   search.tail = 0;
+   visit (&search,-1,0,x,y,0);
+
+   for (head = 0; head < search.tail; head++)
+	 {
+		pos = &search.queue[head];
+		if (!FITS (&search,pos->rotation,pos->x,pos->y + 1))
+		  {
+			 /* it comes to rest here */
+			 placement = &list[count++];
+			 placement->state = search.states[pos->rotation];
+			 placement->x = pos->x;
+			 placement->y = pos->y;
+			 placement->length = pos->length;
+			 for (p = pos; p->from >= 0; p = &search.queue[p->from])
+			   placement->path[p->length - 1] = p->action;
+		  }
+		if (pos->length == PLACEMENT_MAXPATH) continue;
+		/* ties go to whatever is queued first: moves, then drop, then waiting */
+		visit (&search,head,pos->rotation,pos->x - 1,pos->y,ACTION_LEFT);
+		visit (&search,head,pos->rotation,pos->x + 1,pos->y,ACTION_RIGHT);
+		if (numstates > 1) visit (&search,head,(pos->rotation + 1) % numstates,pos->x,pos->y,ACTION_ROTATE);
+		if (FITS (&search,pos->rotation,pos->x,pos->y + 1))
+		  {
+			 for (y = pos->y + 1; FITS (&search,pos->rotation,pos->x,y + 1); y++)
+			   ;
+			 visit (&search,head,pos->rotation,pos->x,y,ACTION_DROP);
+			 visit (&search,head,pos->rotation,pos->x,pos->y + 1,PLACEMENT_WAIT);
+		  }
+	 }
+   return count;
 }
 
+/*
+ * The same moves as engine_reachable_from (), but a row of x at a time:
+ * on each row, whatever it can get to spreads sideways and by rotating
+ * until nothing new turns up, then falls to the next row.
+ */
+int engine_landings (const row_t rows[NUMROWS],int state,int x,int y,placement_t *list)
+{
+   row_t fit[4][NUMROWS],reach[4],grow,more,rest;
+   int states[4],numstates = 1,r,next,row,count = 0;
+   bool changed,any;
+
+   states[0] = state;
+   while (numstates < 4 && SHAPES[states[numstates - 1]].next != state)
+	 {
+		states[numstates] = SHAPES[states[numstates - 1]].next;
+		numstates++;
+	 }
+   for (r = 0; r < numstates; r++)
+	 for (row = 0; row < NUMROWS; row++)
+	   fit[r][row] = fitrow (rows,&SHAPES[states[r]],row);
+
+   memset (reach,0,sizeof (reach));
+   reach[0] = COLBIT (x) & fit[0][y];
+   for (any = reach[0] != 0; any && y < NUMROWS - 1; y++)
+	 {
+		do
+		  {
+			 changed = FALSE;
+			 for (r = 0; r < numstates; r++)
+			   {
+				  for (grow = reach[r]; (more = (grow | grow << 1 | grow >> 1) & fit[r][y]) != grow; grow = more)
+					;
+				  next = r + 1 < numstates ? r + 1 : 0;
+				  more = grow & fit[next][y];
+				  if (grow != reach[r] || (more & ~reach[next]))
+					{
+					   reach[r] = grow;
+					   reach[next] |= more;
+					   changed = TRUE;
+					}
+			   }
+		  }
+		while (changed);
+		any = FALSE;
+		for (r = 0; r < numstates; r++)
+		  {
+			 for (rest = reach[r] & ~fit[r][y + 1]; rest; rest &= rest - 1)
+			   {
+				  list[count].state = states[r];
+				  list[count].x = lowbit (rest);
+				  list[count].y = y;
+				  list[count].length = 0;
+				  count++;
+			   }
+			 reach[r] &= fit[r][y + 1];
+			 any |= reach[r] != 0;
+		  }
+	 }
+   return count;
+}
+
+int engine_reachable (const engine_t *engine,placement_t *list)
+{
+   row_t rows[NUMROWS];
+   engine_rows (engine,rows);
+   return engine_reachable_from (rows,engine->curstate,engine->curx,engine->cury,list);
+}
+
+int engine_place (engine_t *engine,const placement_t *placement,int step)
+{
+   for (; step < placement->length && placement->path[step] != PLACEMENT_WAIT; step++)
+	 engine_move (engine,placement->path[step]);
+   return step;
+}
@@ -29,32 +29,137 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdint.h>
+#include <time.h>
+
 #include "typedefs.h"		/* bool */
 #include "basic.h"		/* board size, shape count, etc */
+#include "rng.h"		/* rng_t */
 
 /*
  * Macros
  */
 
+/* Bit for column x in a row_t */
+#define COLBIT(x)	((row_t) 1 << (x))
+
+/* Columns that are in play (1 .. NUMCOLS - 3) */
+#define PLAYFIELD_ROW	((row_t) (COLBIT (NUMCOLS - 2) - 2))
+
+/* Columns that are wall on every row (0, NUMCOLS - 2, NUMCOLS - 1) */
+#define WALL_ROW	((row_t) (COLBIT (0) | COLBIT (NUMCOLS - 2) | COLBIT (NUMCOLS - 1)))
+
+/* Rows a shape can land in: 1 .. PLAYROWS */
+#define PLAYROWS	(NUMROWS - 3)
+
+/* Columns in play: 1 .. PLAYCOLS */
+#define PLAYCOLS	(NUMCOLS - 3)
+
+/* Bit for row y in a column_t */
+#define ROWBIT(y)	((column_t) 1 << (y))
+
+/*
+ * Count bits in a row, and find the lowest one (r must not be 0). Without
+ * a popcount instruction to hand, gcc's builtin is a library call, which
+ * costs more than adding the bits up in place.
+ */
+#if defined(__GNUC__) && defined(__POPCNT__)
+#define popcount(r) __builtin_popcount (r)
+#else
+static inline int popcount (unsigned int r)
+{
+   r -= (r >> 1) & 0x55555555;
+   r = (r & 0x33333333) + ((r >> 2) & 0x33333333);
+   r = (r + (r >> 4)) & 0x0f0f0f0f;
+   return (int) ((r * 0x01010101) >> 24);
+}
+#endif
+#ifdef __GNUC__
+#define lowbit(r) __builtin_ctz (r)
+#else
+static inline int lowbit (unsigned int r)
+{
+   int x = 0;
+   for (; !(r & 1); r >>= 1) x++;
+   return x;
+}
+#endif
+
+/*
+ * A cell in the color plane: the color in 3 bits, then the challenge
+ * bit (shapes and challenge blocks are never black, so 0 is an empty
+ * cell)
+ */
+#define CELL_CHALLENGE		0x08
+#define CELL_PACK(color)	(((color) & 7) | (((color) & CHALLENGE_MASK) >> 4))
+#define CELL_UNPACK(bits)	(((bits) & 7) | (((bits) & CELL_CHALLENGE) << 4))
+
+/* What is in cell (x,y): 0, WALL or a color possibly with CHALLENGE_MASK */
+#define BOARD_CELL(board,x,y)	board_cell (board,x,y)
+
+/* How high column x is stacked (0 = empty), falling shape included */
+#define BOARD_HEIGHT(board,x)	(PLAYROWS + 1 - lowbit ((board)->cols[x]))
 
 /*
  * Type definitions
  */
 
-typedef int board_t[NUMCOLS][NUMROWS];
+/* One bit per column, bit 0 is the left wall (NUMCOLS must fit) */
+typedef unsigned short row_t;
+
+/* One bit per row, bit 0 is the row off the top (NUMROWS must fit) */
+typedef uint32_t column_t;
+
+/*
+ * The board is kept as bit planes, one row_t per row, so collision
+ * tests and line clears are shifts and ANDs. Colors (and the
+ * CHALLENGE_MASK bit) live in a separate plane that only the display
+ * needs, packed two play cells to a byte (left one low): the walls
+ * never change, so they aren't kept.
+ *
+ * The rest is kept up to date as blocks come and go, so nothing ever
+ * has to count the board over: cols holds the occupied bits again, a
+ * column at a time (the top block of a column is its lowest bit), and
+ * the counts are of blocks in play, the falling shape's included. hash
+ * is zobrist_rows () of the blocks that have come to rest (what
+ * engine_rows () gives), so moving the shape doesn't touch it.
+ */
+typedef struct
+{
+   row_t rows[NUMROWS];				/* occupied cells, walls included */
+   row_t chall[NUMROWS];			/* challenge blocks */
+   unsigned char color[PLAYROWS + 1][PLAYCOLS / 2];	/* CELL_PACK () of each play cell */
+   column_t cols[NUMCOLS];			/* occupied cells by column, walls included */
+   unsigned char fill[NUMROWS];			/* blocks in each row */
+   int blocks;					/* blocks on the board */
+   int challblocks;				/* challenge blocks on the board */
+   uint64_t hash;				/* Zobrist hash of the settled blocks */
+} board_t;
+
+/* See BOARD_CELL () */
+static inline int board_cell (const board_t *board,int x,int y)
+{
+   if (x < 1 || x > PLAYCOLS || y > PLAYROWS) return WALL;
+   x--;
+   return CELL_UNPACK (board->color[y][x >> 1] >> ((x & 1) << 2));
+}
 
 typedef struct
 {
    int x,y;
 } block_t;
 
+/* One orientation of one shape; see SHAPES */
 typedef struct
 {
    int color;
-   int type;
-   bool flipped;
+   int type;			/* SHAPE_Z .. SHAPE_I */
+   int next;			/* state after one rotation */
    block_t block[NUMBLOCKS];
-} shape_t,shapes_t[NUMSHAPES];
+   int left,top;		/* bounding box, relative to (x,y) */
+   int width,height;
+   row_t rowmask[NUMBLOCKS];	/* blocks in each box row, bit 0 at left */
+} shape_t;
 
 typedef struct
 {
@@ -75,40 +180,101 @@ typedef struct engine_struct
    int level;						/* game level */
    int curx,cury;					/* coordinates of current piece */
    int curshape,nextshape;				/* current & next shapes */
+   int curstate;					/* orientation of current shape (index into SHAPES) */
    int prefer_shape;					/* used on some challenge levels */
    int show_special;					/* flat on special challenge levels */
    int score;						/* score */
    int rand_status;					/* -1 : regular; 0 & up: shape counter */
+   uint64_t seed;					/* what rng was started with */
+   rng_t rng;						/* random numbers for this game only */
    int game_mode;					/* traditional, easy, ... */
+   /* int rather than bool: curses has its own idea of how big a bool is */
+   int shownext;					/* score penalty: next shape shown */
+   int dottedlines;					/* score penalty: dotted lines drawn */
+   int headless;					/* no player or screen to wait for */
+   int level_cleared;					/* challenge level just cleared, for the front end to show */
+   int lock;						/* which routine lands shapes, for game_mode (engine_tweak ()) */
+   long long clock_usec;				/* game time, kept by the caller */
    time_t start_time;					/* time and pause for speed mode */
    time_t pause_start;
    time_t pause_end;
    time_t accumulated_pause;
-   shapes_t shapes;					/* shapes */
    board_t board;					/* board */
    status_t status;					/* current status of shapes */
    void (*score_function)(struct engine_struct *);	/* score function */
 } engine_t;
 
+/* The rows a snapshot keeps, PLAYROWS + 1 rounded up to a multiple of eight */
+#define SNAPSHOT_ROWS	((PLAYROWS + 8) & ~7)
+
+/*
+ * A game packed small, for keeping lots of them (engine_snapshot ()):
+ * everything in engine_t but the score function and the wall clock
+ * times of a pause in progress. The board goes as its color plane,
+ * 4 bits a cell, its row and challenge planes and its hash, all copied
+ * back as they are; the columns and counts follow from the rows.
+ */
+typedef struct
+{
+   uint64_t seed;
+   uint64_t rng;
+   int64_t clock_usec;
+   int64_t accumulated_pause;
+   uint64_t hash;
+   status_t status;
+   int32_t level,score,rand_status;
+   signed char curx,cury,curshape,nextshape,curstate,prefer_shape,show_special,game_mode;
+   unsigned char flags;				/* shownext, dottedlines, headless, level_cleared */
+   unsigned char cells[PLAYROWS + 1][PLAYCOLS / 2];
+   row_t rows[SNAPSHOT_ROWS],chall[SNAPSHOT_ROWS];	/* 0 past PLAYROWS, the floor is always the same */
+} engine_snapshot_t;
+
 typedef enum { ACTION_LEFT, ACTION_ROTATE, ACTION_RIGHT, ACTION_DROP } action_t;
 
+/* In a placement's path: let gravity take the shape down a row (EVENT_TICK) */
+#define PLACEMENT_WAIT		4
+
+/* Longest path a placement can take */
+#define PLACEMENT_MAXPATH	32
+
+/* Most placements engine_placements () can find */
+#define MAXPLACEMENTS		(4 * NUMCOLS)
+
+/* Most placements engine_reachable () can find: no more than every other row */
+#define MAXREACHABLE		(4 * (NUMCOLS - 3) * (NUMROWS / 2))
+
+/* Somewhere the falling shape can end up, and the moves that put it there */
+typedef struct
+{
+   int state;					/* orientation (index into SHAPES) */
+   int x,y;					/* where it comes to rest */
+   int length;					/* moves in path */
+   unsigned char path[PLACEMENT_MAXPATH];	/* action_t or PLACEMENT_WAIT */
+} placement_t;
+
 /*
  * Global variables
  */
 
-extern const shapes_t SHAPES;
+/* Every orientation of every shape; the first NUMSHAPES are unrotated */
+extern const shape_t SHAPES[NUMSTATES];
 
 /*
  * Functions
  */
 
 /*
- * Initialize specified tetris engine
+ * Initialize specified tetris engine. Games started with the same seed
+ * (and given the same moves) play out the same. The first call fills in
+ * the Zobrist keys (zobrist_init ()), so threaded programs should make
+ * it before starting any threads.
  */
-void engine_init (engine_t *engine,void (*score_function)(engine_t *));
+void engine_init (engine_t *engine,void (*score_function)(engine_t *),uint64_t seed);
 
 /*
- * Tweak engine values for non-traditional
+ * Tweak engine values for non-traditional. This is also where the
+ * engine settles on a routine for landing shapes in the mode, so the
+ * mode mustn't be changed any other way.
  */
 void engine_tweak (int level, int mode, engine_t *engine);
 
@@ -118,6 +284,28 @@ void engine_tweak (int level, int mode, engine_t *engine);
  */
 void engine_chalset (engine_t *engine);
 
+/*
+ * Time allowed to move a shape before it drops a row, in microseconds
+ * (what DELAY and CHALLENGE_DELAY give for this engine's level).
+ */
+int engine_delay (const engine_t *engine);
+
+/*
+ * Seconds of play so far, going by engine->clock_usec. Whoever drives
+ * the engine keeps that up to date (from a real clock, a replay, or by
+ * adding engine_delay () for each gravity step of a simulated game).
+ */
+time_t engine_runtime (const engine_t *engine);
+
+/*
+ * Go up a level if enough lines have been cleared (not in challenge
+ * or zen mode). Call after engine_evaluate () releases a new shape.
+ *
+ * OUTPUT:
+ *   TRUE if the level changed
+ */
+bool engine_levelcheck (engine_t *engine);
+
 /*
  * Perform the given action on the specified tetris engine
  */
@@ -125,7 +313,10 @@ void engine_move (engine_t *engine,action_t action);
 
 /*
  * Evaluate the status of the specified tetris engine. In challenge mode,
- * might completely reset the board.
+ * might completely reset the board. When it does that because the level
+ * was cleared it sets engine->level_cleared and carries straight on with
+ * the next level; showing that is up to the front end, which clears the
+ * flag when it's done.
  *
  * OUTPUT:
  *   1 = shape moved down one line
@@ -134,4 +325,82 @@ void engine_move (engine_t *engine,action_t action);
  */
 int engine_evaluate (engine_t *engine);
 
+/*
+ * Pack the game into a snapshot
+ */
+void engine_snapshot (const engine_t *engine,engine_snapshot_t *snapshot);
+
+/*
+ * Put a game back the way it was at engine_snapshot (). The engine must
+ * have been through engine_init () (for its score function); its
+ * start_time, pause_start and pause_end are left alone. The planes are
+ * copied back; only the columns and counts are worked out, eight rows
+ * at a time, with no loop over the blocks.
+ */
+void engine_restore (engine_t *engine,const engine_snapshot_t *snapshot);
+
+/*
+ * A 64-bit Zobrist hash of the position: the blocks on the board, the
+ * falling and next shapes and the shape picker's state. Equal positions
+ * hash the same however they came about, so it can stand in for the
+ * whole game when looking for repeats. The falling shape counts by the
+ * cells it is on (which covers where it is and which way up). Colors
+ * and challenge marks don't count.
+ */
+uint64_t engine_hash (const engine_t *engine);
+
+/*
+ * The board's occupied bits without the falling shape, walls included
+ */
+void engine_rows (const engine_t *engine,row_t rows[NUMROWS]);
+
+/*
+ * List every distinct place the falling shape can come to rest by
+ * rotating it where it is, moving it left or right and dropping it,
+ * each with the moves for engine_move () that get it there. list must
+ * have room for MAXPLACEMENTS.
+ *
+ * OUTPUT:
+ *   how many were found (0 if the shape can't move at all)
+ */
+int engine_placements (const engine_t *engine,placement_t *list);
+
+/*
+ * List every place the falling shape can come to rest, going by the
+ * moves a player has: left, right, rotate and drop at any time, with
+ * gravity in between. That takes in slides under overhangs and turns
+ * into gaps that engine_placements () can't get to. Each comes with a
+ * shortest path, which may wait for gravity. Places further away than
+ * PLACEMENT_MAXPATH are left out. list must have room for MAXREACHABLE.
+ *
+ * OUTPUT:
+ *   how many were found
+ */
+int engine_reachable (const engine_t *engine,placement_t *list);
+
+/*
+ * engine_reachable () for a shape in the given state at (x,y) on other
+ * rows (as from engine_rows ()), eg to look ahead at the next shape.
+ * Nothing is found if it doesn't fit where it starts.
+ */
+int engine_reachable_from (const row_t rows[NUMROWS],int state,int x,int y,placement_t *list);
+
+/*
+ * The places engine_reachable_from () finds (with no limit on how far
+ * away), much faster but without paths: their length is 0. For looking
+ * ahead, where only the boards they leave count.
+ */
+int engine_landings (const row_t rows[NUMROWS],int state,int x,int y,placement_t *list);
+
+/*
+ * Make a placement's moves from step on, up to the next PLACEMENT_WAIT.
+ * After the engine_evaluate () that takes the shape down, carry on from
+ * the step after that. Once the path is done the shape lands on the
+ * next engine_evaluate ().
+ *
+ * OUTPUT:
+ *   the step it stopped at (placement->length when done)
+ */
+int engine_place (engine_t *engine,const placement_t *placement,int step);
+
 #endif	/* #ifndef ENGINE_H */
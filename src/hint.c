@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "engine.h"
+#include "ai.h"
+#include "hint.h"
+
+/* Rounds of searching: one shape deep, then two with the beam doubling */
+#define MAXROUNDS	33
+
+/*
+ * Global variables
+ */
+
+static int numthreads = 0;
+static int maxbeam;
+static pthread_t threads[HINT_MAXTHREADS];
+static ai_search_t searches[HINT_MAXTHREADS];
+
+/* everything below is the workers' and the game's, under lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool quit = FALSE;
+static int job = 0;			/* which request: workers drop a search when it changes */
+static engine_t request;
+static long long requested,deadline;	/* microseconds on the monotonic clock */
+static int numrounds;
+static int done[MAXROUNDS];		/* workers through each round */
+static bool found[MAXROUNDS];
+static int bestvalue[MAXROUNDS];
+static placement_t best[MAXROUNDS];
+
+/* how long each hint took to show, in microseconds */
+static long long *latency = NULL;
+static int numlatency = 0,maxlatency = 0,numcomplete = 0;
+
+/*
+ * Functions
+ */
+
+static long long usec_now ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC,&ts);
+   return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Round 0 is one shape deep; after that, two with a beam of 1, 2, 4, ... */
+static int roundbeam (int round)
+{
+   int beam = 1;
+   while (--round > 0 && beam < maxbeam) beam <<= 1;
+   return beam < maxbeam ? beam : maxbeam;
+}
+
+static void *worker (void *arg)
+{
+   ai_search_t *search = arg;
+   engine_t engine;
+   placement_t placement;
+   int myjob = 0,part = search - searches,parts,round,value,n;
+
+   pthread_mutex_lock (&lock);
+   for (;;)
+	 {
+		while (!quit && job == myjob) pthread_cond_wait (&wake,&lock);
+		if (quit) break;
+		myjob = job;
+		engine = request;
+		parts = numthreads;
+		for (round = 0; round < numrounds && job == myjob && usec_now () < deadline; round++)
+		  {
+			 pthread_mutex_unlock (&lock);
+			 n = ai_search_part (search,&engine,round ? 2 : 1,roundbeam (round),part,parts,&AI_WEIGHTS,&placement,&value);
+			 pthread_mutex_lock (&lock);
+			 if (job != myjob) break;
+			 if (n > 0 && (!found[round] || value > bestvalue[round]))
+			   {
+				  found[round] = TRUE;
+				  bestvalue[round] = value;
+				  best[round] = placement;
+			   }
+			 done[round]++;
+		  }
+	 }
+   pthread_mutex_unlock (&lock);
+   return NULL;
+}
+
+int hint_start (int count,int beam)
+{
+   int i;
+
+   if (count <= 0) count = (int) sysconf (_SC_NPROCESSORS_ONLN) - 1;
+   if (count < 1) count = 1;
+   if (count > HINT_MAXTHREADS) count = HINT_MAXTHREADS;
+   maxbeam = beam;
+   for (i = 0; i < count; i++)
+	 if (ai_search_init (&searches[i],beam) != OK) break;
+   count = i;
+   pthread_mutex_lock (&lock);
+   for (i = 0; i < count; i++)
+	 if (pthread_create (&threads[i],NULL,worker,&searches[i]) != 0) break;
+   /* the workers share out the placements by how many there are */
+   numthreads = i;
+   pthread_mutex_unlock (&lock);
+   for (; i < count; i++) ai_search_free (&searches[i]);
+   return numthreads > 0 ? OK : ERR;
+}
+
+void hint_stop ()
+{
+   int i;
+   pthread_mutex_lock (&lock);
+   quit = TRUE;
+   pthread_cond_broadcast (&wake);
+   pthread_mutex_unlock (&lock);
+   for (i = 0; i < numthreads; i++)
+	 {
+		pthread_join (threads[i],NULL);
+		ai_search_free (&searches[i]);
+	 }
+   numthreads = 0;
+   free (latency);
+   latency = NULL;
+   numlatency = maxlatency = 0;
+}
+
+void hint_request (const engine_t *engine,int usec)
+{
+   pthread_mutex_lock (&lock);
+   request = *engine;
+   job++;
+   requested = usec_now ();
+   deadline = requested + usec;
+   /* only look ahead at a next shape that's showing, and will come */
+   numrounds = 1;
+   if (engine->shownext && engine->game_mode != GAME_CHALLENGE)
+	 for (numrounds = 2; numrounds < MAXROUNDS && roundbeam (numrounds - 1) < maxbeam; numrounds++)
+	   ;
+   memset (done,0,sizeof (done));
+   memset (found,0,sizeof (found));
+   pthread_cond_broadcast (&wake);
+   pthread_mutex_unlock (&lock);
+}
+
+bool hint_result (placement_t *placement,int *complete)
+{
+   int round;
+   pthread_mutex_lock (&lock);
+   for (round = numrounds - 1; round >= 0; round--)
+	 if (done[round] == numthreads && found[round]) break;
+   if (round >= 0)
+	 {
+		*placement = best[round];
+		*complete = round == numrounds - 1;
+	 }
+   pthread_mutex_unlock (&lock);
+   return round >= 0;
+}
+
+void hint_cancel ()
+{
+   pthread_mutex_lock (&lock);
+   deadline = 0;
+   pthread_mutex_unlock (&lock);
+}
+
+void hint_shown (int complete)
+{
+   long long *more;
+   if (numlatency == maxlatency)
+	 {
+		more = realloc (latency,(maxlatency ? 2 * maxlatency : 256) * sizeof (long long));
+		if (more == NULL) return;
+		latency = more;
+		maxlatency = maxlatency ? 2 * maxlatency : 256;
+	 }
+   pthread_mutex_lock (&lock);
+   latency[numlatency++] = usec_now () - requested;
+   pthread_mutex_unlock (&lock);
+   if (complete) numcomplete++;
+}
+
+static int cmplatency (const void *a,const void *b)
+{
+   long long la = *(const long long *) a,lb = *(const long long *) b;
+   return (la > lb) - (la < lb);
+}
+
+void hint_report (FILE *fp)
+{
+   if (numlatency == 0) return;
+   qsort (latency,numlatency,sizeof (long long),cmplatency);
+   fprintf (fp,"%d hints (%d%% fully searched, %d threads) on screen after %.1f ms median, "
+			"%.1f ms p90, %.1f ms p99, %.1f ms max\n",
+			numlatency,numcomplete * 100 / numlatency,numthreads,
+			latency[numlatency / 2] / 1000.0,latency[numlatency - 1 - numlatency / 10] / 1000.0,
+			latency[numlatency - 1 - numlatency / 100] / 1000.0,latency[numlatency - 1] / 1000.0);
+}
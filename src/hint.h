@@ -0,0 +1,106 @@
+#ifndef HINT_H
+#define HINT_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+
+#include "typedefs.h"
+#include "engine.h"		/* engine_t, placement_t */
+
+/*
+ * Hints while playing: worker threads search for where the falling
+ * shape should go (see ai_search_part ()), each taking its share of the
+ * shape's placements. They go deeper and wider in rounds, one shape
+ * ahead with the widest beam last, until they run out of rounds or
+ * time. The best answer of the last round every worker finished is the
+ * hint, and it can be asked for at any time without waiting.
+ */
+
+/*
+ * Macros
+ */
+
+/* Most worker threads */
+#define HINT_MAXTHREADS		8
+
+/* A hint is due this fraction of a gravity step after it's asked for */
+#define HINT_DEADLINE(delay)	((delay) / 4)
+
+/*
+ * Functions
+ */
+
+/*
+ * Start the workers: count of them (0 = one less than there are
+ * cores), searching no wider than beam
+ *
+ * OUTPUT:
+ *   OK, or ERR if no thread could be started
+ */
+int hint_start (int count,int beam);
+
+/*
+ * Stop and free the workers
+ */
+void hint_stop ();
+
+/*
+ * Start looking for a hint for the engine's falling shape, to be ready
+ * usec microseconds from now. Drops any search still going.
+ */
+void hint_request (const engine_t *engine,int usec);
+
+/*
+ * The best hint so far for the last request, if there is one. Searching
+ * stops once the deadline has passed.
+ *
+ * OUTPUT:
+ *   TRUE if there was one. complete is TRUE if every round was done
+ *   (an int rather than a bool: curses has its own idea of how big a
+ *   bool is).
+ */
+bool hint_result (placement_t *placement,int *complete);
+
+/*
+ * Stop searching for the last request
+ */
+void hint_cancel ();
+
+/*
+ * Note that the last request's hint is on screen now (for hint_report ())
+ */
+void hint_shown (int complete);
+
+/*
+ * Print how many hints were shown and how long they took
+ */
+void hint_report (FILE *fp);
+
+#endif	/* #ifndef HINT_H */
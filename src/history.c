@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "scorefile.h"		/* put32 () and friends */
+#include "history.h"
+
+/* Where column c starts in a block, and how wide its numbers are */
+#define COLUMN(c)	((c) ? HISTORY_CHUNK * (4 * (c) + 4) : 0)
+#define WIDTH(c)	((c) ? 4 : 8)
+
+/* Column c of game g */
+static int64_t field (const game_t *g,int c)
+{
+   switch (c)
+	 {
+	  case HISTORY_TIME:		return g->timestamp;
+	  case HISTORY_MODE:		return g->mode;
+	  case HISTORY_START:		return g->start_level;
+	  case HISTORY_LEVEL:		return g->level;
+	  case HISTORY_SCORE:		return g->score;
+	  case HISTORY_LINES:		return g->lines;
+	  case HISTORY_DURATION:	return g->duration;
+	  case HISTORY_EFFICIENCY:	return g->efficiency;
+	  default:			return g->shapecount[c - HISTORY_SHAPES];
+	 }
+}
+
+/* Write count games into the block at offset, starting at slot */
+static int write_block (int fd,off_t offset,int slot,const game_t *games,int count)
+{
+   unsigned char buf[HISTORY_CHUNK * 8];
+   int c,i;
+
+   for (c = 0; c < HISTORY_COLUMNS; c++)
+	 {
+		for (i = 0; i < count; i++)
+		  if (c == HISTORY_TIME) put64 (buf + 8 * i,(uint64_t) field (&games[i],c));
+		  else put32 (buf + 4 * i,(uint32_t) field (&games[i],c));
+		if (pwrite (fd,buf,count * WIDTH(c),offset + COLUMN(c) + slot * WIDTH(c)) != count * WIDTH(c))
+		  return ERR;
+	 }
+   return OK;
+}
+
+/* With the file locked: add the games and then count them */
+static int append (int fd,const game_t *games,int count)
+{
+   unsigned char header[HISTORY_HEADER];
+   size_t len = strlen (HISTORY_MAGIC_NUMBER);
+   struct stat st;
+   uint32_t n;
+   off_t offset;
+   int slot,done;
+
+   if (fstat (fd,&st) != 0) return ERR;
+   if (st.st_size == 0)
+	 {
+		memcpy (header,HISTORY_MAGIC_NUMBER,len);
+		put32 (header + len,0);
+	 }
+   else if (pread (fd,header,HISTORY_HEADER,0) != HISTORY_HEADER || memcmp (header,HISTORY_MAGIC_NUMBER,len) != 0)
+	 return ERR;
+   n = get32 (header + len);
+   while (count > 0)
+	 {
+		slot = n % HISTORY_CHUNK;
+		done = HISTORY_CHUNK - slot < count ? HISTORY_CHUNK - slot : count;
+		offset = HISTORY_HEADER + (off_t) (n / HISTORY_CHUNK) * HISTORY_BLOCK;
+		/* a new block is a hole until it's written */
+		if (st.st_size < offset + HISTORY_BLOCK)
+		  {
+			 if (ftruncate (fd,offset + HISTORY_BLOCK) != 0) return ERR;
+			 st.st_size = offset + HISTORY_BLOCK;
+		  }
+		if (write_block (fd,offset,slot,games,done) != OK) return ERR;
+		games += done;
+		count -= done;
+		n += done;
+	 }
+   put32 (header + len,n);
+   return pwrite (fd,header,HISTORY_HEADER,0) == HISTORY_HEADER ? OK : ERR;
+}
+
+int history_append (const char *file,const game_t *games,int count)
+{
+   int fd,result = ERR;
+
+   if ((fd = open (file,O_RDWR | O_CREAT,0644)) < 0) return ERR;
+   while (flock (fd,LOCK_EX) != 0 && errno == EINTR)
+	 ;
+   /* two games finishing together each get their own slots */
+   result = append (fd,games,count);
+   if (close (fd) != 0) result = ERR;
+   return result;
+}
+
+/* The month entry for key (year * 12 + month - 1), or NULL if it's too old to show */
+static history_month_t *month (history_stats_t *stats,int key)
+{
+   int i,j;
+
+   for (i = stats->months; i > 0 && stats->month[i - 1].year * 12 + stats->month[i - 1].month - 1 >= key; i--)
+	 if (stats->month[i - 1].year * 12 + stats->month[i - 1].month - 1 == key) return &stats->month[i - 1];
+   /* it goes in at i, the oldest going if we're full */
+   if (stats->months == HISTORY_MONTHS)
+	 {
+		if (i == 0) return NULL;
+		memmove (stats->month,stats->month + 1,(HISTORY_MONTHS - 1) * sizeof (history_month_t));
+		stats->months--;
+		i--;
+	 }
+   for (j = stats->months; j > i; j--) stats->month[j] = stats->month[j - 1];
+   stats->months++;
+   memset (&stats->month[i],0,sizeof (history_month_t));
+   stats->month[i].year = key / 12;
+   stats->month[i].month = key % 12 + 1;
+   return &stats->month[i];
+}
+
+/* Game i of a block's column c */
+#define GET(c,i)	((int32_t) get32 (data + COLUMN(c) + 4 * (i)))
+
+/* Fill in the game in slot i of the block at data */
+static void unpack (game_t *game,const unsigned char *data,int i)
+{
+   int c;
+   game->timestamp = (time_t) (int64_t) get64 (data + COLUMN(HISTORY_TIME) + 8 * i);
+   game->mode = GET(HISTORY_MODE,i);
+   game->start_level = GET(HISTORY_START,i);
+   game->level = GET(HISTORY_LEVEL,i);
+   game->score = GET(HISTORY_SCORE,i);
+   game->lines = GET(HISTORY_LINES,i);
+   game->duration = GET(HISTORY_DURATION,i);
+   game->efficiency = GET(HISTORY_EFFICIENCY,i);
+   for (c = 0; c < NUMSHAPES; c++) game->shapecount[c] = GET(HISTORY_SHAPES + c,i);
+}
+
+/*
+ * Add up count games of the block at data. It's done a column at a
+ * time, each one read straight through, with the games' modes looked
+ * up once; games of no mode we know are added up in an extra row that
+ * is then dropped.
+ */
+static void add_block (history_stats_t *stats,const unsigned char *data,int count)
+{
+   unsigned char mode[HISTORY_CHUNK];
+   long long sum[GAME_MODE_COUNT + 1][HISTORY_COLUMNS];
+   int most[GAME_MODE_COUNT + 1][HISTORY_COLUMNS];
+   int best[GAME_MODE_COUNT + 1];
+   long games[GAME_MODE_COUNT + 1];
+   history_totals_t *totals;
+   history_month_t *current = NULL;
+   time_t t,start = 0,end = 0;
+   struct tm tm;
+   int c,i,m;
+
+   memset (sum,0,sizeof (sum));
+   memset (most,0,sizeof (most));
+   memset (games,0,sizeof (games));
+   for (m = 0; m <= GAME_MODE_COUNT; m++) best[m] = -1;
+   for (i = 0; i < count; i++)
+	 {
+		m = GET(HISTORY_MODE,i);
+		mode[i] = m < MODE_LOW || m > MODE_HIGH ? GAME_MODE_COUNT : m;
+		games[mode[i]]++;
+	 }
+   for (c = HISTORY_START; c < HISTORY_COLUMNS; c++)
+	 for (i = 0; i < count; i++)
+	   {
+		  sum[mode[i]][c] += GET(c,i);
+		  if (GET(c,i) > most[mode[i]][c]) most[mode[i]][c] = GET(c,i);
+	   }
+   for (i = 0; i < count; i++)
+	 if (best[mode[i]] < 0 || GET(HISTORY_SCORE,i) > GET(HISTORY_SCORE,best[mode[i]])) best[mode[i]] = i;
+
+   for (m = 0; m < GAME_MODE_COUNT; m++)
+	 {
+		if (games[m] == 0) continue;
+		totals = &stats->mode[m];
+		if (totals->games == 0 || GET(HISTORY_SCORE,best[m]) > totals->best.score) unpack (&totals->best,data,best[m]);
+		totals->games += games[m];
+		totals->score += sum[m][HISTORY_SCORE];
+		totals->lines += sum[m][HISTORY_LINES];
+		totals->duration += sum[m][HISTORY_DURATION];
+		totals->efficiency += sum[m][HISTORY_EFFICIENCY];
+		for (c = 0; c < NUMSHAPES; c++) totals->shapes[c] += sum[m][HISTORY_SHAPES + c];
+		if (most[m][HISTORY_LINES] > totals->most_lines) totals->most_lines = most[m][HISTORY_LINES];
+		if (most[m][HISTORY_LEVEL] > totals->top_level) totals->top_level = most[m][HISTORY_LEVEL];
+	 }
+
+   /* games come in order, so the month rarely changes */
+   for (i = 0; i < count; i++)
+	 {
+		t = (time_t) (int64_t) get64 (data + COLUMN(HISTORY_TIME) + 8 * i);
+		if (t < start || t >= end)
+		  {
+			 localtime_r (&t,&tm);
+			 m = (tm.tm_year + 1900) * 12 + tm.tm_mon;
+			 tm.tm_mday = 1;
+			 tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+			 tm.tm_isdst = -1;
+			 start = mktime (&tm);
+			 tm.tm_mon++;
+			 tm.tm_isdst = -1;
+			 end = mktime (&tm);
+			 current = month (stats,m);
+		  }
+		if (current != NULL && mode[i] != GAME_MODE_COUNT)
+		  {
+			 current->games[mode[i]]++;
+			 current->score[mode[i]] += GET(HISTORY_SCORE,i);
+		  }
+	 }
+}
+
+int history_stats (const char *file,history_stats_t *stats)
+{
+   struct stat st;
+   unsigned char *data;
+   size_t size,len = strlen (HISTORY_MAGIC_NUMBER);
+   long n,done;
+   int fd,result = OK;
+
+   memset (stats,0,sizeof (history_stats_t));
+   if ((fd = open (file,O_RDONLY)) < 0) return errno == ENOENT ? OK : ERR;
+   if (fstat (fd,&st) != 0 || st.st_size < HISTORY_HEADER)
+	 {
+		/* an empty one is no games too */
+		result = fstat (fd,&st) == 0 && st.st_size == 0 ? OK : ERR;
+		close (fd);
+		return result;
+	 }
+   size = st.st_size;
+   data = mmap (NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+   close (fd);
+   if (data == MAP_FAILED) return ERR;
+   /* we'll be going straight through it */
+   madvise (data,size,MADV_SEQUENTIAL);
+
+   n = get32 (data + len);
+   if (memcmp (data,HISTORY_MAGIC_NUMBER,len) != 0 ||
+	   size < HISTORY_HEADER + (size_t) ((n + HISTORY_CHUNK - 1) / HISTORY_CHUNK) * HISTORY_BLOCK)
+	 result = ERR;
+   else
+	 {
+		stats->games = n;
+		for (done = 0; done < n; done += HISTORY_CHUNK)
+		  add_block (stats,data + HISTORY_HEADER + (size_t) (done / HISTORY_CHUNK) * HISTORY_BLOCK,
+					 n - done < HISTORY_CHUNK ? n - done : HISTORY_CHUNK);
+	 }
+   munmap (data,size);
+   return result;
+}
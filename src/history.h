@@ -0,0 +1,141 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "typedefs.h"
+#include "basic.h"		/* GAME_MODE_COUNT, NUMSHAPES */
+
+/*
+ * Every game a player finishes, kept in their own history file. The
+ * file is the HISTORY_MAGIC_NUMBER header and the number of games in
+ * it, then blocks of HISTORY_CHUNK games. Inside a block the games are
+ * stored column by column (all the scores, then all the lines, ...),
+ * so going through millions of games for one number only reads that
+ * number's column, and it reads it straight through. Every game takes
+ * the same room, and all numbers are little-endian.
+ *
+ * A game is added by writing its columns into the last block and then
+ * bumping the count, so a game that was only partly written is never
+ * seen.
+ */
+
+/*
+ * Macros
+ */
+
+#define HISTORY_MAGIC_NUMBER	"<notint history version=1>"
+#define HISTORY_HEADER		(sizeof (HISTORY_MAGIC_NUMBER) - 1 + 4)
+
+/* Games per block */
+#define HISTORY_CHUNK		1024
+
+/* Columns: timestamp is 8 bytes, the rest 4 */
+#define HISTORY_TIME		0
+#define HISTORY_MODE		1
+#define HISTORY_START		2	/* starting level */
+#define HISTORY_LEVEL		3	/* level at the end */
+#define HISTORY_SCORE		4
+#define HISTORY_LINES		5
+#define HISTORY_DURATION	6	/* milliseconds, not counting pauses */
+#define HISTORY_EFFICIENCY	7
+#define HISTORY_SHAPES		8	/* NUMSHAPES columns of shape counts */
+#define HISTORY_COLUMNS		(HISTORY_SHAPES + NUMSHAPES)
+
+/* Bytes per game, and per block */
+#define HISTORY_RECORD		(4 * HISTORY_COLUMNS + 4)
+#define HISTORY_BLOCK		(HISTORY_CHUNK * HISTORY_RECORD)
+
+/* Months of trends shown */
+#define HISTORY_MONTHS		12
+
+/*
+ * Type definitions
+ */
+
+/* One game */
+typedef struct
+{
+   time_t timestamp;		/* when it ended */
+   int mode;
+   int start_level,level;
+   int score;
+   int lines;
+   int duration;		/* milliseconds */
+   int efficiency;
+   int shapecount[NUMSHAPES];
+} game_t;
+
+/* Totals for the games of one mode */
+typedef struct
+{
+   long games;
+   long long score,lines,duration,efficiency;
+   long shapes[NUMSHAPES];
+   game_t best;			/* best score */
+   int most_lines;
+   int top_level;
+} history_totals_t;
+
+/* Totals for one calendar month */
+typedef struct
+{
+   int year,month;		/* 2026, 1 to 12 */
+   long games[GAME_MODE_COUNT];
+   long long score[GAME_MODE_COUNT];
+} history_month_t;
+
+typedef struct
+{
+   long games;			/* in the file */
+   history_totals_t mode[GAME_MODE_COUNT];
+   history_month_t month[HISTORY_MONTHS];	/* most recent months played, newest last */
+   int months;
+} history_stats_t;
+
+/*
+ * Functions
+ */
+
+/*
+ * Add count games to the end of a history file, creating it if
+ * needed. Returns OK or ERR.
+ */
+int history_append (const char *file,const game_t *games,int count);
+
+/*
+ * Add up a history file. Returns OK, or ERR if it can't be read (a
+ * missing file is just no games).
+ */
+int history_stats (const char *file,history_stats_t *stats);
+
+#endif	/* #ifndef HISTORY_H */
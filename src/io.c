@@ -28,8 +28,10 @@
  */
 
 #include <stdarg.h>		/* va_list(), va_start(), va_end() */
-#include <sys/time.h>	/* gettimeofday() */
-#include <unistd.h>		/* gettimeofday() */
+#include <time.h>		/* clock_gettime() */
+#include <poll.h>		/* poll() */
+#include <errno.h>		/* errno, EINTR */
+#include <unistd.h>		/* STDIN_FILENO */
 
 #include "io.h"
 
@@ -52,14 +54,23 @@ static int attr_map[NUM_ATTRS];
 /* Current attribute used on screen */
 static int out_attr;
 
-/* Current color used on screen */
-static short out_color;
+/* Color pair for each foreground and background, set up by io_init () */
+static int color_pair[NUM_COLORS][NUM_COLORS];
+
+/* What was last given to attrset (), -1 if we don't know */
+static int out_current = -1;
+
+/* Number of times attrset () was called since out_attrchanges () */
+static unsigned long out_changes;
 
 /* This is the timeout in microseconds */
 static int in_timetotal;
 
-/* This is the amount of time left to before a timeout occurs (in microseconds) */
-static int in_timeleft;
+/* When the next timeout is due, in microseconds on the monotonic clock */
+static long long in_deadline;
+
+/* When the alarm is due, likewise (0 = not set) */
+static long long in_alarmtime = 0;
 
 /*
  * Init & Close
@@ -68,12 +79,13 @@ static int in_timeleft;
 /* Initialize screen */
 void io_init ()
 {
+   int fg,bg;
+   short pair;
    initscr ();
    cbreak ();
    start_color ();
    curs_set (CURSOR_INVISIBLE);
    out_attr = A_NORMAL;
-   out_color = COLOR_WHITE;
    noecho ();
    /* Map colors */
    color_map[COLOR_BLACK] = COLOR_BLACK;
@@ -92,6 +104,15 @@ void io_init ()
    attr_map[ATTR_BLINK] = A_BLINK;
    attr_map[ATTR_REVERSE] = A_REVERSE;
    attr_map[ATTR_INVISIBLE] = A_INVIS;
+   /* Set up every color pair once (pair 0 is curses' own and can't be changed) */
+   for (bg = 0; bg < NUM_COLORS; bg++) for (fg = 0; fg < NUM_COLORS; fg++)
+	 {
+		pair = (color_map[bg] << 3) + color_map[fg];
+		if (pair) init_pair (pair,color_map[fg],color_map[bg]);
+		color_pair[fg][bg] = COLOR_PAIR (pair);
+	 }
+   out_current = -1;
+   out_changes = 0;
 
   keypad(stdscr, TRUE);
 }
@@ -102,6 +123,7 @@ void io_close ()
    echo ();
    nocbreak ();
    attrset (A_NORMAL);
+   out_current = -1;
    clear ();
    curs_set (CURSOR_NORMAL);
    refresh ();
@@ -121,9 +143,19 @@ void out_setattr (int attr)
 /* Set color */
 void out_setcolor (int fg,int bg)
 {
-   out_color = (color_map[bg] << 3) + color_map[fg];
-   init_pair (out_color,color_map[fg],color_map[bg]);
-   attrset (COLOR_PAIR (out_color) | out_attr);
+   int attr = color_pair[fg][bg] | out_attr;
+   if (attr == out_current) return;
+   attrset (attr);
+   out_current = attr;
+   out_changes++;
+}
+
+/* Number of attribute changes since the last call */
+unsigned long out_attrchanges ()
+{
+   unsigned long changes = out_changes;
+   out_changes = 0;
+   return changes;
 }
 
 /* Move cursor to position (x,y) on the screen. Upper corner of screen is (0,0) */
@@ -176,39 +208,72 @@ void out_beep ()
  * Input
  */
 
-/* Read a character. Please note that you MUST call in_timeout() before in_getch() */
+/* Microseconds on a clock that never goes backwards */
+static long long in_now ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC,&ts);
+   return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Read a character. Please note that you MUST call in_timeout() before in_getch()
+ *
+ * Returns ERR when the timeout is due; the next one is then due one
+ * timeout later than this one was, not one timeout from now, so the
+ * keys pressed in between don't slow the game down. An alarm going off
+ * in between doesn't move the timeout either.
+ */
 int in_getch ()
 {
-   struct timeval starttv,endtv;
-   int ch;
-   timeout (in_timeleft / 1000);
-   gettimeofday (&starttv,NULL);
-   ch = getch ();
-   gettimeofday (&endtv,NULL);
-   /* Timeout? */
-   if (ch == ERR)
-	 in_timeleft = in_timetotal;
-   /* No? Then calculate time left */
-   else
+   struct pollfd pfd;
+   long long left,due;
+   int ch,n;
+   pfd.fd = STDIN_FILENO;
+   pfd.events = POLLIN;
+   timeout (0);
+   for (;;)
 	 {
-		endtv.tv_sec -= starttv.tv_sec;
-		endtv.tv_usec -= starttv.tv_usec;
-		if (endtv.tv_usec < 0)
+		/* curses may already have a key buffered */
+		if ((ch = getch ()) != ERR) return ch;
+		if (in_alarmtime && in_alarmtime <= in_now ())
 		  {
-			 endtv.tv_usec += 1000000;
-			 endtv.tv_sec--;
+			 in_alarmtime = 0;
+			 return IN_ALARM;
 		  }
-		in_timeleft -= endtv.tv_usec;
-		if (in_timeleft <= 0) in_timeleft = in_timetotal;
+		/* sleep until a key is pressed or the timeout (or alarm) is due */
+		due = in_alarmtime && in_alarmtime < in_deadline ? in_alarmtime : in_deadline;
+		left = due - in_now ();
+		/* a signal (the terminal being resized, say) just means going round again */
+		if (left > 0 && (n = poll (&pfd,1,(int) ((left + 999) / 1000))) != 0 && (n > 0 || errno == EINTR)) continue;
+		if (in_now () >= in_deadline) break;
 	 }
+   in_deadline += in_timetotal;
+   /* we fell far behind (suspended?), don't try to catch up */
+   if (in_deadline < in_now ()) in_deadline = in_now () + in_timetotal;
+   return ERR;
+}
+
+/* Wait for a key, however long it takes, then start the timeout over */
+int in_wait ()
+{
+   int ch;
+   timeout (-1);
+   while ((ch = getch ()) == ERR) ;
+   in_deadline = in_now () + in_timetotal;
    return ch;
 }
 
 /* Set keyboard timeout in microseconds */
 void in_timeout (int delay)
 {
-   /* ncurses timeout() function works with milliseconds, not microseconds */
-   in_timetotal = in_timeleft = delay;
+   in_timetotal = delay;
+   in_deadline = in_now () + delay;
+}
+
+void in_alarm (int delay)
+{
+   in_alarmtime = in_now () + delay;
 }
 
 /* Empty keyboard buffer */
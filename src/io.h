@@ -32,25 +32,7 @@
 #include <curses.h>
 #include <wchar.h>
 
-/*
- * Colors
- */
-
-#ifndef COLOR_BLACK
-/* 
- * Assume black is a good test for the first seven colors.
- * curses.h on NetBSD defines all these, but curses.h on
- * Linux does not.
- */
-#define COLOR_BLACK     0                        /* Black */
-#define COLOR_RED       1                        /* Red */
-#define COLOR_GREEN     2                        /* Green */
-#define COLOR_YELLOW    3                        /* Yellow */
-#define COLOR_BLUE      4                        /* Blue */
-#define COLOR_MAGENTA   5                        /* Magenta */
-#define COLOR_CYAN      6                        /* Cyan */
-#define COLOR_WHITE     7                        /* White */
-#endif
+#include "colors.h"
 
 /*
  * Attributes
@@ -84,6 +66,9 @@ void out_setattr (int attr);
 /* Set color */
 void out_setcolor (int fg,int bg);
 
+/* Number of attribute changes since the last call */
+unsigned long out_attrchanges ();
+
 /* Move cursor to position (x,y) on the screen. Upper corner of screen is (0,0) */
 void out_gotoxy (int x,int y);
 
@@ -109,12 +94,21 @@ void out_beep ();
  * Input
  */
 
-/* Read a character */
+/* What in_getch () returns when the alarm goes (curses has no such key) */
+#define IN_ALARM	(-2)
+
+/* Read a character, ERR when the timeout is due, IN_ALARM when the alarm is */
 int in_getch ();
 
+/* Wait for a key, however long it takes, then start the timeout over */
+int in_wait ();
+
 /* Set keyboard timeout in microseconds */
 void in_timeout (int delay);
 
+/* Have in_getch () return IN_ALARM once, delay microseconds from now */
+void in_alarm (int delay);
+
 /* Empty keyboard buffer */
 void in_flush ();
 
@@ -0,0 +1,955 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "scorefile.h"
+#include "leaderboard.h"
+
+/* Order within a mode: best first, then oldest first, then by name */
+static int cmpentries (const score_t *a,const score_t *b)
+{
+   if (a->score != b->score) return a->score > b->score ? -1 : 1;
+   if (a->timestamp != b->timestamp) return a->timestamp < b->timestamp ? -1 : 1;
+   return strncmp (a->name,b->name,NAMELEN);
+}
+
+void leaderboard_init (leaderboard_t *lb)
+{
+   memset (lb,0,sizeof (leaderboard_t));
+   lb->rand = 2463534242U;
+}
+
+void leaderboard_free (leaderboard_t *lb)
+{
+   free (lb->nodes);
+   free (lb->players);
+   leaderboard_init (lb);
+}
+
+/*
+ * The treaps
+ */
+
+#define NODE(t)		(lb->nodes[t])
+#define SIZE(t)		((t) ? NODE(t).size : 0)
+
+/* xorshift32, good enough to keep the trees balanced */
+static uint32_t priority (leaderboard_t *lb)
+{
+   uint32_t x = lb->rand;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return lb->rand = x;
+}
+
+static void resize (leaderboard_t *lb,int t)
+{
+   NODE(t).size = SIZE(NODE(t).left) + SIZE(NODE(t).right) + 1;
+}
+
+/* Put node n in the tree t, returning the new root of it */
+static int insert (leaderboard_t *lb,int t,int n)
+{
+   int child;
+
+   if (t == 0) return n;
+   if (cmpentries (&NODE(n).entry,&NODE(t).entry) < 0)
+	 {
+		child = NODE(t).left = insert (lb,NODE(t).left,n);
+		if (NODE(child).prio > NODE(t).prio)
+		  {
+			 /* rotate right */
+			 NODE(t).left = NODE(child).right;
+			 NODE(child).right = t;
+			 resize (lb,t);
+			 t = child;
+		  }
+	 }
+   else
+	 {
+		child = NODE(t).right = insert (lb,NODE(t).right,n);
+		if (NODE(child).prio > NODE(t).prio)
+		  {
+			 /* rotate left */
+			 NODE(t).right = NODE(child).left;
+			 NODE(child).left = t;
+			 resize (lb,t);
+			 t = child;
+		  }
+	 }
+   resize (lb,t);
+   return t;
+}
+
+/* Is entry in the tree t? */
+static bool find (const leaderboard_t *lb,int t,const score_t *entry)
+{
+   int c;
+   while (t)
+	 {
+		if ((c = cmpentries (entry,&NODE(t).entry)) == 0) return TRUE;
+		t = c < 0 ? NODE(t).left : NODE(t).right;
+	 }
+   return FALSE;
+}
+
+/*
+ * The players
+ */
+
+static uint32_t hashname (const char *name)
+{
+   uint32_t hash = 2166136261U;
+   int i;
+   for (i = 0; i < NAMELEN && name[i] != '\0'; i++) hash = (hash ^ (unsigned char) name[i]) * 16777619U;
+   return hash;
+}
+
+/* The slot for name in players, which is either it or an unused one */
+static lb_player_t *slot (lb_player_t *players,int maxplayers,const char *name)
+{
+   uint32_t i = hashname (name);
+   while (players[i & (maxplayers - 1)].name[0] != '\0' &&
+		  strncmp (players[i & (maxplayers - 1)].name,name,NAMELEN) != 0)
+	 i++;
+   return &players[i & (maxplayers - 1)];
+}
+
+static lb_player_t *player (leaderboard_t *lb,const char *name)
+{
+   lb_player_t *p,*players;
+   int i,maxplayers;
+
+   /* keep it at most half full */
+   if (2 * (lb->numplayers + 1) > lb->maxplayers)
+	 {
+		maxplayers = lb->maxplayers ? 2 * lb->maxplayers : 64;
+		if ((players = calloc (maxplayers,sizeof (lb_player_t))) == NULL) return NULL;
+		for (i = 0; i < lb->maxplayers; i++)
+		  if (lb->players[i].name[0] != '\0')
+			*slot (players,maxplayers,lb->players[i].name) = lb->players[i];
+		free (lb->players);
+		lb->players = players;
+		lb->maxplayers = maxplayers;
+	 }
+   p = slot (lb->players,lb->maxplayers,name);
+   if (p->name[0] == '\0')
+	 {
+		memcpy (p->name,name,strnlen (name,NAMELEN - 1));
+		for (i = 0; i < GAME_MODE_COUNT; i++) p->best[i] = -1;
+		lb->numplayers++;
+	 }
+   return p;
+}
+
+/*
+ * The rest
+ */
+
+int leaderboard_insert (leaderboard_t *lb,const score_t *entry)
+{
+   lb_node_t *nodes;
+   lb_player_t *p;
+   score_t *top;
+   int i,n,mode = entry->trad_mode;
+
+   if (mode < MODE_LOW || mode > MODE_HIGH || entry->name[0] == '\0') return FALSE;
+   if (find (lb,lb->root[mode],entry)) return FALSE;
+   if (lb->numnodes + 1 >= lb->maxnodes)
+	 {
+		n = lb->maxnodes ? 2 * lb->maxnodes : 1024;
+		if ((nodes = realloc (lb->nodes,n * sizeof (lb_node_t))) == NULL) return ERR;
+		lb->nodes = nodes;
+		lb->maxnodes = n;
+	 }
+   if ((p = player (lb,entry->name)) == NULL) return ERR;
+   if (entry->score > p->best[mode]) p->best[mode] = entry->score;
+
+   n = ++lb->numnodes;
+   NODE(n).entry = *entry;
+   NODE(n).left = NODE(n).right = 0;
+   NODE(n).size = 1;
+   NODE(n).prio = priority (lb);
+   lb->root[mode] = insert (lb,lb->root[mode],n);
+
+   /* and the best few, where it's a plain insertion sort */
+   top = lb->top[mode];
+   i = lb->numtop[mode];
+   if (i == NUMSCORES && cmpentries (entry,&top[i - 1]) >= 0) return TRUE;
+   if (i < NUMSCORES) lb->numtop[mode]++;
+   else i--;
+   for ( ; i > 0 && cmpentries (entry,&top[i - 1]) < 0; i--) top[i] = top[i - 1];
+   top[i] = *entry;
+   return TRUE;
+}
+
+void leaderboard_standing (const leaderboard_t *lb,const score_t *entry,standing_t *standing)
+{
+   int t,mode = entry->trad_mode;
+   long rank = 1;
+
+   standing->rank = standing->count = 0;
+   standing->best = -1;
+   if (mode < MODE_LOW || mode > MODE_HIGH) return;
+   /* count the scores that come before it */
+   for (t = lb->root[mode]; t; )
+	 if (cmpentries (entry,&NODE(t).entry) <= 0) t = NODE(t).left;
+	 else
+	   {
+		  rank += SIZE(NODE(t).left) + 1;
+		  t = NODE(t).right;
+	   }
+   standing->rank = rank;
+   standing->count = SIZE(lb->root[mode]);
+   standing->best = leaderboard_best (lb,mode,entry->name);
+}
+
+int leaderboard_best (const leaderboard_t *lb,int mode,const char *name)
+{
+   const lb_player_t *p;
+   if (mode < MODE_LOW || mode > MODE_HIGH || lb->maxplayers == 0) return -1;
+   p = slot (lb->players,lb->maxplayers,name);
+   return p->name[0] != '\0' ? p->best[mode] : -1;
+}
+
+const score_t *leaderboard_top (const leaderboard_t *lb,int mode,int *count)
+{
+   *count = lb->numtop[mode];
+   return lb->top[mode];
+}
+
+/*
+ * The files
+ */
+
+/* A snapshot, mapped */
+typedef struct
+{
+   unsigned char *data;
+   size_t size;
+   const unsigned char *records[GAME_MODE_COUNT];	/* each mode's, best first */
+   size_t count[GAME_MODE_COUNT];
+   const unsigned char *players;			/* by name */
+   size_t numplayers;
+} snapshot_t;
+
+/* name in file's leaderboard directory, or with "" the directory; NULL if out of memory */
+static char *filename (const char *file,const char *name)
+{
+   char *path = malloc (strlen (file) + strlen (LEADERBOARD_SUFFIX) + strlen (name) + 2);
+   if (path != NULL) sprintf (path,*name != '\0' ? "%s%s/%s" : "%s%s",file,LEADERBOARD_SUFFIX,name);
+   return path;
+}
+
+/* Make the leaderboard directory if it isn't there yet */
+static int makedir (const char *file)
+{
+   char *dir = filename (file,"");
+   int result = dir != NULL && (mkdir (dir,0775) == 0 || errno == EEXIST) ? OK : ERR;
+   free (dir);
+   return result;
+}
+
+/* Give path the score file's permissions, it may be shared by a group */
+static void share (const char *file,const char *path)
+{
+   struct stat st;
+   if (stat (file,&st) == 0) chmod (path,st.st_mode & 07777);
+}
+
+/* Map all of a file, returning NULL if it's missing or empty */
+static unsigned char *map (const char *file,size_t *size)
+{
+   struct stat st;
+   unsigned char *data;
+   int fd;
+
+   if ((fd = open (file,O_RDONLY)) < 0) return NULL;
+   if (fstat (fd,&st) != 0 || st.st_size == 0)
+	 {
+		close (fd);
+		return NULL;
+	 }
+   *size = st.st_size;
+   data = mmap (NULL,*size,PROT_READ,MAP_PRIVATE,fd,0);
+   close (fd);
+   return data != MAP_FAILED ? data : NULL;
+}
+
+static void closeboard (snapshot_t *snap)
+{
+   if (snap->data != NULL) munmap (snap->data,snap->size);
+   snap->data = NULL;
+}
+
+/*
+ * Map a snapshot and see that it adds up. Only a full check reads it
+ * all (for the checksum); otherwise just the header is looked at.
+ * Returns FALSE if it's missing or doesn't add up.
+ */
+static bool openboard (snapshot_t *snap,const char *board,bool full)
+{
+   size_t i,total = 0,len = strlen (LEADERBOARD_MAGIC_NUMBER);
+   const unsigned char *rec;
+
+   memset (snap,0,sizeof (snapshot_t));
+   if ((snap->data = map (board,&snap->size)) == NULL) return FALSE;
+   if (snap->size >= LEADERBOARD_HEADER && memcmp (snap->data,LEADERBOARD_MAGIC_NUMBER,len) == 0)
+	 {
+		rec = snap->data + LEADERBOARD_HEADER;
+		for (i = 0; i < GAME_MODE_COUNT; i++)
+		  {
+			 snap->records[i] = rec + total * SCOREFILE_RECORD;
+			 total += snap->count[i] = get32 (snap->data + len + 4 * i);
+		  }
+		snap->players = rec + total * SCOREFILE_RECORD;
+		snap->numplayers = get32 (snap->data + LEADERBOARD_HEADER - 8);
+		if (snap->size - LEADERBOARD_HEADER == total * SCOREFILE_RECORD + snap->numplayers * LEADERBOARD_PLAYER &&
+			(!full || get32 (snap->data + LEADERBOARD_HEADER - 4) == scorefile_checksum (rec,snap->size - LEADERBOARD_HEADER)))
+		  return TRUE;
+	 }
+   closeboard (snap);
+   return FALSE;
+}
+
+/*
+ * How many of the snapshot's scores of entry's mode come before it,
+ * found in O(log n) as they're in order. *found is whether it's there.
+ */
+static size_t before (const snapshot_t *snap,const score_t *entry,bool *found)
+{
+   const unsigned char *rec = snap->records[entry->trad_mode];
+   size_t mid,lo = 0,hi = snap->count[entry->trad_mode];
+   score_t other;
+
+   while (lo < hi)
+	 {
+		mid = lo + (hi - lo) / 2;
+		scorefile_unpack (&other,rec + mid * SCOREFILE_RECORD);
+		if (cmpentries (&other,entry) < 0) lo = mid + 1;
+		else hi = mid;
+	 }
+   *found = FALSE;
+   if (lo < snap->count[entry->trad_mode])
+	 {
+		scorefile_unpack (&other,rec + lo * SCOREFILE_RECORD);
+		*found = cmpentries (&other,entry) == 0;
+	 }
+   return lo;
+}
+
+/* A player's best score of a mode in the snapshot, -1 if none */
+static int snapbest (const snapshot_t *snap,int mode,const char *name)
+{
+   size_t mid,lo = 0,hi = snap->numplayers;
+   const unsigned char *p;
+   int c;
+
+   while (lo < hi)
+	 {
+		mid = lo + (hi - lo) / 2;
+		p = snap->players + mid * LEADERBOARD_PLAYER;
+		if ((c = strncmp ((const char *) p,name,NAMELEN)) == 0) return (int32_t) get32 (p + NAMELEN + 4 * mode);
+		if (c < 0) lo = mid + 1;
+		else hi = mid;
+	 }
+   return -1;
+}
+
+static void packplayer (unsigned char *p,const lb_player_t *player)
+{
+   int i;
+   memset (p,0,NAMELEN);
+   memcpy (p,player->name,strnlen (player->name,NAMELEN - 1));
+   for (i = 0; i < GAME_MODE_COUNT; i++) put32 (p + NAMELEN + 4 * i,(uint32_t) player->best[i]);
+}
+
+/* Fill in the header of a snapshot ending at end; returns its size */
+static size_t seal (unsigned char *buf,const size_t count[GAME_MODE_COUNT],size_t numplayers,const unsigned char *end)
+{
+   size_t i,len = strlen (LEADERBOARD_MAGIC_NUMBER);
+
+   memcpy (buf,LEADERBOARD_MAGIC_NUMBER,len);
+   for (i = 0; i < GAME_MODE_COUNT; i++) put32 (buf + len + 4 * i,count[i]);
+   put32 (buf + LEADERBOARD_HEADER - 8,numplayers);
+   put32 (buf + LEADERBOARD_HEADER - 4,scorefile_checksum (buf + LEADERBOARD_HEADER,end - buf - LEADERBOARD_HEADER));
+   return end - buf;
+}
+
+/* Insert count records, returning how many went in or ERR */
+static int insert_records (leaderboard_t *lb,const unsigned char *rec,size_t count)
+{
+   score_t entry;
+   int result,added = 0;
+   for ( ; count--; rec += SCOREFILE_RECORD)
+	 {
+		scorefile_unpack (&entry,rec);
+		if (entry.score < 1) continue;
+		if ((result = leaderboard_insert (lb,&entry)) == ERR) return ERR;
+		added += result;
+	 }
+   return added;
+}
+
+/* OK, ERR or SCOREFILE_BAD; *found is whether there was one at all */
+static int load_snapshot (leaderboard_t *lb,const char *board,bool *found)
+{
+   snapshot_t snap;
+   size_t i,total = 0;
+   struct stat st;
+   int result = SCOREFILE_BAD;
+
+   *found = stat (board,&st) == 0;
+   if (openboard (&snap,board,TRUE))
+	 {
+		for (i = 0; i < GAME_MODE_COUNT; i++) total += snap.count[i];
+		/* the modes follow each other, so that's all of them */
+		result = insert_records (lb,snap.records[0],total) == ERR ? ERR : OK;
+		closeboard (&snap);
+	 }
+   return *found ? result : OK;
+}
+
+/* Whatever's in a log; a partly written last record doesn't count. ERR or the records read */
+static long load_log (leaderboard_t *lb,const char *log)
+{
+   unsigned char *data;
+   size_t size;
+   int result;
+
+   if ((data = map (log,&size)) == NULL) return 0;
+   result = insert_records (lb,data,size / SCOREFILE_RECORD);
+   munmap (data,size);
+   return result == ERR ? ERR : (long) (size / SCOREFILE_RECORD);
+}
+
+static int load_scorefile (leaderboard_t *lb,const char *file)
+{
+   score_t scores[BIG_NUMSCORES];
+   int i;
+
+   scorefile_init (scores);
+   if (scorefile_read (file,scores) < 0) return OK;
+   for (i = 0; i < BIG_NUMSCORES; i++)
+	 if (scores[i].score > 0 && leaderboard_insert (lb,&scores[i]) == ERR) return ERR;
+   return OK;
+}
+
+int leaderboard_load (leaderboard_t *lb,const char *file)
+{
+   char *board,*log,*old;
+   long logged,aside;
+   bool found;
+   int result = ERR;
+
+   board = filename (file,"board");
+   log = filename (file,"log");
+   old = filename (file,"log.old");
+   if (board != NULL && log != NULL && old != NULL && (result = load_snapshot (lb,board,&found)) != ERR)
+	 {
+		/* a log set aside by a compaction that didn't finish counts too */
+		if ((aside = load_log (lb,old)) == ERR || (logged = load_log (lb,log)) == ERR) result = ERR;
+		/* the old high scores are the first entries of a new leaderboard */
+		else if ((!found || result != OK) && load_scorefile (lb,file) != OK) result = ERR;
+		else lb->logged = aside + logged;
+	 }
+   free (board);
+   free (log);
+   free (old);
+   return result;
+}
+
+/* Append count entries to log, the log of file */
+static int append (const char *file,const char *log,const score_t *entries,int count)
+{
+   unsigned char *buf;
+   struct stat st;
+   off_t end;
+   int i,fd,result = ERR;
+
+   buf = malloc (count * SCOREFILE_RECORD + 1);
+   if (buf != NULL && makedir (file) == OK && (fd = open (log,O_WRONLY | O_CREAT,0644)) >= 0)
+	 {
+		/* same permissions as the score file, it may be shared by a group */
+		if (stat (file,&st) == 0) fchmod (fd,st.st_mode & 07777);
+		for (i = 0; i < count; i++) scorefile_pack (buf + i * SCOREFILE_RECORD,&entries[i]);
+		/* write over anything a crash left half written */
+		if (fstat (fd,&st) == 0)
+		  {
+			 end = st.st_size - st.st_size % SCOREFILE_RECORD;
+			 if (end == st.st_size || ftruncate (fd,end) == 0)
+			   if (pwrite (fd,buf,count * SCOREFILE_RECORD,end) == count * SCOREFILE_RECORD)
+				 result = OK;
+		  }
+		if (close (fd) != 0) result = ERR;
+	 }
+   free (buf);
+   return result;
+}
+
+int leaderboard_append (leaderboard_t *lb,const char *file,const score_t *entries,int count)
+{
+   char *log;
+   int result = ERR;
+
+   if ((log = filename (file,"log")) != NULL && (result = append (file,log,entries,count)) == OK)
+	 lb->logged += count;
+   free (log);
+   return result;
+}
+
+/*
+ * Compacting: the log is renamed out of the way for new scores to go
+ * in a new one, folded into a new snapshot with nobody waiting, and the
+ * new snapshot renamed over the old one as the set aside log goes. Only
+ * the two renames need the score file's lock, and the readers see the
+ * same scores before, during and after. One process at a time does it.
+ */
+
+typedef struct
+{
+   char *board,*old;
+   int fd;				/* compacting lock */
+   bool busy;				/* somebody else has it */
+} compact_t;
+
+static void endcompact (compact_t *c)
+{
+   if (c->fd >= 0) close (c->fd);
+   free (c->board);
+   free (c->old);
+}
+
+/*
+ * Become the one compacting, waiting for it if wait, and set the log
+ * aside. OK or ERR (with c->busy if it's ERR because somebody else is
+ * at it).
+ */
+static int startcompact (compact_t *c,const char *file,bool wait)
+{
+   char *log = filename (file,"log"),*lock = filename (file,"compact.lock");
+   struct stat st;
+   int fd,result = ERR;
+
+   c->board = filename (file,"board");
+   c->old = filename (file,"log.old");
+   c->fd = -1;
+   c->busy = FALSE;
+   if (log != NULL && lock != NULL && c->board != NULL && c->old != NULL && makedir (file) == OK &&
+	   (c->fd = open (lock,O_RDONLY | O_CREAT,0644)) >= 0)
+	 {
+		while ((result = flock (c->fd,wait ? LOCK_EX : LOCK_EX | LOCK_NB)) != 0 && errno == EINTR) ;
+		if (result != 0)
+		  {
+			 c->busy = errno == EWOULDBLOCK;
+			 result = ERR;
+		  }
+		/* a log still set aside from last time goes first */
+		else if ((fd = scorefile_lock (file)) < 0) result = ERR;
+		else
+		  {
+			 if (stat (c->old,&st) != 0 && rename (log,c->old) != 0 && errno != ENOENT) result = ERR;
+			 scorefile_unlock (fd);
+		  }
+	 }
+   free (log);
+   free (lock);
+   return result;
+}
+
+/* Put the new snapshot of len bytes from buf in place */
+static int finishcompact (compact_t *c,const char *file,const unsigned char *buf,size_t len)
+{
+   char *temp = malloc (strlen (c->board) + 5);
+   int fd,result = ERR;
+
+   if (temp != NULL && scorefile_writenew (c->board,buf,len) == OK)
+	 {
+		sprintf (temp,"%s.new",c->board);
+		share (file,temp);
+		if ((fd = scorefile_lock (file)) >= 0)
+		  {
+			 if (rename (temp,c->board) == 0)
+			   {
+				  unlink (c->old);
+				  result = OK;
+			   }
+			 scorefile_unlock (fd);
+		  }
+		if (result != OK) unlink (temp);
+	 }
+   free (temp);
+   return result;
+}
+
+/* Pack the tree t into rec in order, returning where it left off */
+static unsigned char *packtree (const leaderboard_t *lb,int t,unsigned char *rec)
+{
+   while (t)
+	 {
+		rec = packtree (lb,NODE(t).left,rec);
+		scorefile_pack (rec,&NODE(t).entry);
+		rec += SCOREFILE_RECORD;
+		t = NODE(t).right;
+	 }
+   return rec;
+}
+
+static int cmpplayers (const void *a,const void *b)
+{
+   return strncmp (((const lb_player_t *) a)->name,((const lb_player_t *) b)->name,NAMELEN);
+}
+
+int leaderboard_save (leaderboard_t *lb,const char *file)
+{
+   unsigned char *buf = NULL,*p;
+   lb_player_t *players = NULL;
+   size_t count[GAME_MODE_COUNT],len;
+   compact_t c;
+   int i,numplayers = 0,result;
+   bool found;
+
+   if ((result = startcompact (&c,file,TRUE)) == OK)
+	 {
+		/*
+		 * what was logged since lb was loaded goes in too, whether it's
+		 * still set aside or another compaction got it in the snapshot
+		 */
+		if (load_snapshot (lb,c.board,&found) == ERR || load_log (lb,c.old) == ERR ||
+			(players = malloc ((lb->numplayers + 1) * sizeof (lb_player_t))) == NULL ||
+			(buf = malloc (len = LEADERBOARD_HEADER + (size_t) lb->numnodes * SCOREFILE_RECORD +
+						   (size_t) lb->numplayers * LEADERBOARD_PLAYER)) == NULL)
+		  result = ERR;
+		else
+		  {
+			 for (i = 0, p = buf + LEADERBOARD_HEADER; i < GAME_MODE_COUNT; i++)
+			   {
+				  count[i] = SIZE(lb->root[i]);
+				  p = packtree (lb,lb->root[i],p);
+			   }
+			 for (i = 0; i < lb->maxplayers; i++)
+			   if (lb->players[i].name[0] != '\0') players[numplayers++] = lb->players[i];
+			 qsort (players,numplayers,sizeof (lb_player_t),cmpplayers);
+			 for (i = 0; i < numplayers; i++, p += LEADERBOARD_PLAYER) packplayer (p,&players[i]);
+			 if ((result = finishcompact (&c,file,buf,seal (buf,count,numplayers,p))) == OK) lb->logged = 0;
+		  }
+	 }
+   endcompact (&c);
+   free (players);
+   free (buf);
+   return result;
+}
+
+/* Log entries by mode, then in order */
+static int cmplogged (const void *a,const void *b)
+{
+   const score_t *x = a,*y = b;
+   if (x->trad_mode != y->trad_mode) return x->trad_mode - y->trad_mode;
+   return cmpentries (x,y);
+}
+
+/* Log entries by player */
+static int cmpnames (const void *a,const void *b)
+{
+   return strncmp (((const score_t *) a)->name,((const score_t *) b)->name,NAMELEN);
+}
+
+/* Read the scores in a log worth having; NULL if out of memory */
+static score_t *readlog (const char *log,size_t *count)
+{
+   unsigned char *data;
+   score_t *entries;
+   size_t i,size = 0;
+
+   *count = 0;
+   data = map (log,&size);
+   if ((entries = malloc ((size / SCOREFILE_RECORD + 1) * sizeof (score_t))) != NULL)
+	 for (i = 0; i < size / SCOREFILE_RECORD; i++)
+	   {
+		  scorefile_unpack (&entries[*count],data + i * SCOREFILE_RECORD);
+		  if (entries[*count].score > 0 && entries[*count].name[0] != '\0' &&
+			  entries[*count].trad_mode >= MODE_LOW && entries[*count].trad_mode <= MODE_HIGH)
+			++*count;
+	   }
+   if (data != NULL) munmap (data,size);
+   return entries;
+}
+
+/*
+ * Merge the sorted snapshot and the sorted log set aside into buf, the
+ * size of both; returns the end of the records. Scores in both go in
+ * once.
+ */
+static unsigned char *mergerecords (const snapshot_t *snap,const score_t *entries,size_t numentries,
+									size_t count[GAME_MODE_COUNT],unsigned char *rec)
+{
+   const unsigned char *from;
+   unsigned char *start;
+   score_t last,other;
+   size_t i,j;
+   bool have;
+   int mode;
+
+   for (mode = 0; mode < GAME_MODE_COUNT; mode++)
+	 {
+		start = rec;
+		from = snap->records[mode];
+		i = 0;
+		have = FALSE;
+		for (j = 0; j < numentries && entries[j].trad_mode < mode; j++) ;
+		while (i < snap->count[mode] || (j < numentries && entries[j].trad_mode == mode))
+		  {
+			 if (i < snap->count[mode]) scorefile_unpack (&other,from + i * SCOREFILE_RECORD);
+			 if (i < snap->count[mode] &&
+				 (j == numentries || entries[j].trad_mode != mode || cmpentries (&other,&entries[j]) <= 0))
+			   i++;
+			 else other = entries[j++];
+			 if (have && cmpentries (&other,&last) == 0) continue;
+			 scorefile_pack (rec,&other);
+			 rec += SCOREFILE_RECORD;
+			 last = other;
+			 have = TRUE;
+		  }
+		count[mode] = (rec - start) / SCOREFILE_RECORD;
+	 }
+   return rec;
+}
+
+/* The same for the players, with the entries sorted by name; returns the end */
+static unsigned char *mergeplayers (const snapshot_t *snap,const score_t *entries,size_t numentries,
+									size_t *numplayers,unsigned char *p)
+{
+   const unsigned char *from;
+   lb_player_t player;
+   size_t i = 0,j = 0;
+   int mode;
+
+   for (*numplayers = 0; i < snap->numplayers || j < numentries; ++*numplayers, p += LEADERBOARD_PLAYER)
+	 {
+		from = snap->players + i * LEADERBOARD_PLAYER;
+		if (j == numentries || (i < snap->numplayers && strncmp ((const char *) from,entries[j].name,NAMELEN) < 0))
+		  {
+			 memcpy (p,from,LEADERBOARD_PLAYER);
+			 i++;
+			 continue;
+		  }
+		memset (&player,0,sizeof (player));
+		memcpy (player.name,entries[j].name,strnlen (entries[j].name,NAMELEN - 1));
+		for (mode = 0; mode < GAME_MODE_COUNT; mode++) player.best[mode] = -1;
+		if (i < snap->numplayers && strncmp ((const char *) from,entries[j].name,NAMELEN) == 0)
+		  {
+			 for (mode = 0; mode < GAME_MODE_COUNT; mode++)
+			   player.best[mode] = (int32_t) get32 (from + NAMELEN + 4 * mode);
+			 i++;
+		  }
+		for ( ; j < numentries && strncmp (entries[j].name,player.name,NAMELEN) == 0; j++)
+		  if (entries[j].score > player.best[entries[j].trad_mode])
+			player.best[entries[j].trad_mode] = entries[j].score;
+		packplayer (p,&player);
+	 }
+   return p;
+}
+
+/*
+ * Both the snapshot and the log set aside are in order once that's
+ * sorted, so this is a merge: O(n) for the n scores in the snapshot,
+ * without building any trees. A snapshot that's missing or damaged is
+ * built again from all there is instead.
+ */
+int leaderboard_compact (const char *file)
+{
+   unsigned char *buf = NULL,*p;
+   score_t *entries = NULL;
+   size_t count[GAME_MODE_COUNT],numentries,numplayers,total = 0,len;
+   snapshot_t snap;
+   leaderboard_t lb;
+   compact_t c;
+   int i,fd,result;
+
+   if ((result = startcompact (&c,file,FALSE)) == OK)
+	 {
+		if (!openboard (&snap,c.board,TRUE))
+		  {
+			 endcompact (&c);
+			 leaderboard_init (&lb);
+			 if ((fd = scorefile_lock (file)) < 0) return ERR;
+			 result = leaderboard_load (&lb,file);
+			 scorefile_unlock (fd);
+			 if (result != ERR) result = leaderboard_save (&lb,file);
+			 leaderboard_free (&lb);
+			 return result;
+		  }
+		for (i = 0; i < GAME_MODE_COUNT; i++) total += snap.count[i];
+		if ((entries = readlog (c.old,&numentries)) == NULL ||
+			(buf = malloc (len = LEADERBOARD_HEADER + (total + numentries) * (SCOREFILE_RECORD + LEADERBOARD_PLAYER))) == NULL)
+		  result = ERR;
+		else
+		  {
+			 qsort (entries,numentries,sizeof (score_t),cmplogged);
+			 p = mergerecords (&snap,entries,numentries,count,buf + LEADERBOARD_HEADER);
+			 qsort (entries,numentries,sizeof (score_t),cmpnames);
+			 p = mergeplayers (&snap,entries,numentries,&numplayers,p);
+			 result = finishcompact (&c,file,buf,seal (buf,count,numplayers,p));
+		  }
+		closeboard (&snap);
+	 }
+   if (c.busy) result = OK;
+   endcompact (&c);
+   free (entries);
+   free (buf);
+   return result;
+}
+
+/* Load all there is and add entry, for when there's no snapshot to go by */
+static int rebuild (const char *file,const score_t *entry,standing_t *standing)
+{
+   char *log = filename (file,"log");
+   leaderboard_t lb;
+   int fd,result = ERR;
+
+   leaderboard_init (&lb);
+   if (log != NULL && (fd = scorefile_lock (file)) >= 0)
+	 {
+		/* a damaged snapshot gets replaced, like a damaged score file */
+		if (leaderboard_load (&lb,file) != ERR && (result = leaderboard_insert (&lb,entry)) != ERR)
+		  result = result == TRUE ? append (file,log,entry,1) : OK;
+		scorefile_unlock (fd);
+		if (result == OK)
+		  {
+			 leaderboard_standing (&lb,entry,standing);
+			 /* entry is safe in the log, so this can fail and be done next time */
+			 leaderboard_save (&lb,file);
+		  }
+	 }
+   leaderboard_free (&lb);
+   free (log);
+   return result;
+}
+
+/*
+ * Count the records of entry's mode, the ones that come before it, and
+ * the player's best among them. Returns TRUE if entry is one of them.
+ */
+static bool tally (const unsigned char *rec,size_t count,const score_t *entry,standing_t *standing)
+{
+   score_t other;
+   bool found = FALSE;
+   int c;
+
+   for ( ; count--; rec += SCOREFILE_RECORD)
+	 {
+		if ((int32_t) get32 (rec + SCOREFILE_MODE) != entry->trad_mode) continue;
+		scorefile_unpack (&other,rec);
+		if (other.score < 1) continue;
+		standing->count++;
+		if ((c = cmpentries (&other,entry)) < 0) standing->rank++;
+		else if (c == 0) found = TRUE;
+		if (other.score > standing->best && strncmp (other.name,entry->name,NAMELEN) == 0)
+		  standing->best = other.score;
+	 }
+   return found;
+}
+
+/* tally () a log; *count gets the records in it */
+static bool tallylog (const char *log,const score_t *entry,standing_t *standing,size_t *count)
+{
+   unsigned char *data;
+   size_t size;
+   bool found;
+
+   *count = 0;
+   if ((data = map (log,&size)) == NULL) return FALSE;
+   *count = size / SCOREFILE_RECORD;
+   found = tally (data,*count,entry,standing);
+   munmap (data,size);
+   return found;
+}
+
+/*
+ * The snapshot's scores are in order, so where entry stands among them
+ * is a binary search, as is the player's best. Only the log, which is
+ * never much more than LEADERBOARD_COMPACT records, is gone through.
+ * The lock is held for that and for appending entry; folding the log
+ * into a new snapshot, when it's time, is done after letting go.
+ */
+int leaderboard_submit (const char *file,const score_t *entry,standing_t *standing)
+{
+   char *board,*log,*old;
+   size_t aside,logged = 0;
+   snapshot_t snap;
+   bool seen;
+   int fd,result = ERR,mode = entry->trad_mode;
+
+   if (mode < MODE_LOW || mode > MODE_HIGH || entry->name[0] == '\0') return ERR;
+   board = filename (file,"board");
+   log = filename (file,"log");
+   old = filename (file,"log.old");
+   if (board != NULL && log != NULL && old != NULL && (fd = scorefile_lock (file)) >= 0)
+	 {
+		if (!openboard (&snap,board,FALSE))
+		  {
+			 scorefile_unlock (fd);
+			 result = rebuild (file,entry,standing);
+		  }
+		else
+		  {
+			 standing->rank = 1 + before (&snap,entry,&seen);
+			 standing->count = snap.count[mode];
+			 standing->best = snapbest (&snap,mode,entry->name);
+			 closeboard (&snap);
+			 seen |= tallylog (old,entry,standing,&aside);
+			 seen |= tallylog (log,entry,standing,&logged);
+			 if (seen) result = OK;
+			 else if ((result = append (file,log,entry,1)) == OK)
+			   {
+				  standing->count++;
+				  if (entry->score > standing->best) standing->best = entry->score;
+				  logged++;
+			   }
+			 scorefile_unlock (fd);
+			 if (result == OK && logged >= LEADERBOARD_COMPACT) leaderboard_compact (file);
+		  }
+	 }
+   free (board);
+   free (log);
+   free (old);
+   return result;
+}
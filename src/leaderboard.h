@@ -0,0 +1,183 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+#include "typedefs.h"		/* score_t */
+#include "basic.h"		/* GAME_MODE_COUNT, NUMSCORES */
+
+/*
+ * Every score ever saved, not just the best NUMSCORES of each mode, so
+ * a player can be told where they stand among all of them. Each mode's
+ * scores are a treap (a binary search tree kept balanced by random
+ * priorities) where every node knows how many nodes hang below it, so
+ * adding a score and finding the rank of one both take O(log n). The
+ * best NUMSCORES of each mode are also kept in order on the side, and
+ * each player's best score is found through a hash table on the name.
+ *
+ * On disk it's a directory, <scorefile>.leaderboard, which the game
+ * must be able to create files in. In it are board, a snapshot of all
+ * the scores, and log, the scores added since, one version 5 record
+ * each (see scorefile.h). The snapshot has each mode's scores in order
+ * and the players' best scores by name, so a game that just ended can
+ * find where it stands with binary searches in the mapped file,
+ * without building any trees. Adding a score just appends to the log;
+ * once the log gets long it's set aside (log.old) and merged with the
+ * snapshot into a new one, which is then renamed over it.
+ */
+
+/*
+ * Macros
+ */
+
+/* Added to the score file's name for the leaderboard's directory */
+#define LEADERBOARD_SUFFIX		".leaderboard"
+
+/*
+ * After the magic number: uint32 scores of each mode, uint32 players
+ * and uint32 checksum of the rest. Then all the scores of the first
+ * mode, best first, those of the next one, and so on; then the
+ * players.
+ */
+#define LEADERBOARD_MAGIC_NUMBER	"<notint leaderboard version=2>"
+#define LEADERBOARD_HEADER		(sizeof (LEADERBOARD_MAGIC_NUMBER) - 1 + 4 * GAME_MODE_COUNT + 8)
+
+/* A player: name, then int32 best score of each mode (-1 for none) */
+#define LEADERBOARD_PLAYER		(NAMELEN + 4 * GAME_MODE_COUNT)
+
+/* Log entries before it's worth writing a new snapshot */
+#define LEADERBOARD_COMPACT		4096
+
+/*
+ * Type definitions
+ */
+
+typedef struct
+{
+   score_t entry;
+   int left,right;		/* children, 0 for none */
+   int size;			/* nodes in this subtree, this one included */
+   uint32_t prio;		/* parents have higher ones than children */
+} lb_node_t;
+
+typedef struct
+{
+   char name[NAMELEN];		/* empty for an unused slot */
+   int best[GAME_MODE_COUNT];	/* -1 if never played that mode */
+} lb_player_t;
+
+typedef struct
+{
+   lb_node_t *nodes;		/* node 0 is never used, 0 means none */
+   int numnodes,maxnodes;
+   int root[GAME_MODE_COUNT];
+   score_t top[GAME_MODE_COUNT][NUMSCORES];
+   int numtop[GAME_MODE_COUNT];
+   lb_player_t *players;	/* open addressing, maxplayers a power of two */
+   int numplayers,maxplayers;
+   uint32_t rand;		/* for node priorities */
+   int logged;			/* entries in the log since the snapshot */
+} leaderboard_t;
+
+/* Where one score stands */
+typedef struct
+{
+   long rank;			/* 1 for the best score of the mode */
+   long count;			/* scores in the mode */
+   int best;			/* the player's best in the mode */
+} standing_t;
+
+/*
+ * Functions
+ */
+
+/* Start empty, and free everything */
+void leaderboard_init (leaderboard_t *lb);
+void leaderboard_free (leaderboard_t *lb);
+
+/*
+ * Add a score. Returns TRUE if it was added, FALSE if it was already
+ * there (or not a score), ERR if out of memory.
+ */
+int leaderboard_insert (leaderboard_t *lb,const score_t *entry);
+
+/* Where entry stands (or would, if it isn't in) among its mode's scores */
+void leaderboard_standing (const leaderboard_t *lb,const score_t *entry,standing_t *standing);
+
+/* A player's best score in a mode, -1 if none */
+int leaderboard_best (const leaderboard_t *lb,int mode,const char *name);
+
+/* The best scores of a mode, best first; *count of them, at most NUMSCORES */
+const score_t *leaderboard_top (const leaderboard_t *lb,int mode,int *count);
+
+/*
+ * Read the snapshot and logs of the score file file into an empty lb.
+ * Call with the score file locked (see scorefile_lock ()). Until
+ * there's a snapshot, the scores in the score file itself are taken as
+ * the start of the leaderboard. Missing files are just no scores.
+ *
+ * OUTPUT:
+ *   OK, ERR if out of memory, or SCOREFILE_BAD if the snapshot is
+ *   damaged (lb then has the log and the score file)
+ */
+int leaderboard_load (leaderboard_t *lb,const char *file);
+
+/*
+ * Append entries to the log. Call with the score file locked (see
+ * scorefile_lock ()). Returns OK or ERR.
+ */
+int leaderboard_append (leaderboard_t *lb,const char *file,const score_t *entries,int count);
+
+/*
+ * Fold the log into a new snapshot. This takes the score file's lock
+ * itself, and only to set the log aside and to put the new snapshot in
+ * place; so call it without the lock. If somebody else is already at
+ * it, it's left to them. Returns OK or ERR.
+ */
+int leaderboard_compact (const char *file);
+
+/*
+ * Write all of lb out as the new snapshot, for when the one on disk
+ * is damaged. Like leaderboard_compact (), and whatever the snapshot
+ * and log got since lb was loaded is folded into lb first. Returns OK
+ * or ERR.
+ */
+int leaderboard_save (leaderboard_t *lb,const char *file);
+
+/*
+ * All of the above for one game that just ended and nobody keeping a
+ * leaderboard in memory: add entry to the log and tell where it stands,
+ * in O(log n) for the n scores in the snapshot, and compact when it's
+ * time. Returns OK or ERR.
+ */
+int leaderboard_submit (const char *file,const score_t *entry,standing_t *standing);
+
+#endif	/* #ifndef LEADERBOARD_H */
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * notintd: keeps the high scores in memory and serves them to notint
+ * over a Unix socket (see scoresock.h), so that games on a busy machine
+ * don't all read, sort and rewrite the score file as they finish. New
+ * scores are written out a little later, several at a time, merged
+ * with whatever is in the file by then. The whole leaderboard is kept
+ * in memory too, so a player's rank costs no file reading at all.
+ * notint goes back to using the file itself whenever notintd isn't
+ * running. Only those who may write the score file may connect (see
+ * scoresock_listen ()).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "config.h"
+#include "utils.h"
+#include "scorefile.h"
+#include "leaderboard.h"
+#include "scoresock.h"
+
+/* Seconds to wait after a new score before writing the file */
+#define WRITE_DELAY	10
+
+static char *scorefile = NULL;
+static char *scoresocket = NULL;
+static int write_delay = WRITE_DELAY;
+
+static score_t scores[BIG_NUMSCORES];
+static leaderboard_t board;
+static score_t *pending = NULL;		/* new scores for the leaderboard's log */
+static int numpending = 0,maxpending = 0;
+static bool rebuild = FALSE;		/* the snapshot needs writing over */
+static time_t dirty = 0;		/* when the first unsaved score came in */
+static volatile sig_atomic_t quit = FALSE;
+
+static void stop (int sig)
+{
+   quit = TRUE;
+}
+
+/* Write out what we have, merged with the file (someone may have used it directly) */
+static void flush ()
+{
+   score_t merged[BIG_NUMSCORES];
+   int lock,result = scorefile_add (scorefile,scores,BIG_NUMSCORES,merged);
+   if (result == OK) memcpy (scores,merged,sizeof (scores));
+   if (result == OK && numpending)
+	 {
+		if ((lock = scorefile_lock (scorefile)) < 0) result = ERR;
+		else
+		  {
+			 if (leaderboard_append (&board,scorefile,pending,numpending) != OK) result = ERR;
+			 else numpending = 0;
+			 scorefile_unlock (lock);
+		  }
+	 }
+   /* these take the lock themselves, only for as long as they must */
+   if (result == OK && rebuild)
+	 {
+		if ((result = leaderboard_save (&board,scorefile)) == OK) rebuild = FALSE;
+	 }
+   else if (result == OK && board.logged >= LEADERBOARD_COMPACT)
+	 {
+		if ((result = leaderboard_compact (scorefile)) == OK) board.logged = 0;
+	 }
+   if (result != OK) fprintf (stderr,"notintd: cannot write %s, will try again\n",scorefile);
+   dirty = result == OK ? 0 : time (NULL);
+}
+
+/* Add a score to the leaderboard, to be logged with the next flush () */
+static bool rank (const score_t *entry)
+{
+   score_t *more;
+   int n;
+
+   if (numpending == maxpending)
+	 {
+		n = maxpending ? 2 * maxpending : 64;
+		if ((more = realloc (pending,n * sizeof (score_t))) == NULL) return FALSE;
+		pending = more;
+		maxpending = n;
+	 }
+   if (leaderboard_insert (&board,entry) != TRUE) return FALSE;
+   pending[numpending++] = *entry;
+   return TRUE;
+}
+
+/* Answer one request */
+static void serve (int fd)
+{
+   unsigned char req[1 + SCOREFILE_RECORD];
+   unsigned char answer[1 + BIG_NUMSCORES * SCOREFILE_RECORD + SCORESOCK_STANDING];
+   unsigned char *p = answer + 1 + BIG_NUMSCORES * SCOREFILE_RECORD;
+   struct timeval tv;
+   standing_t standing;
+   score_t entry;
+   int i;
+
+   /* nobody gets to keep us waiting */
+   tv.tv_sec = SCORESOCK_TIMEOUT;
+   tv.tv_usec = 0;
+   setsockopt (fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof (tv));
+   setsockopt (fd,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof (tv));
+   if (scoresock_recv (fd,req,1) != OK) return;
+   if (req[0] == SCORESOCK_SUBMIT)
+	 {
+		if (scoresock_recv (fd,req + 1,SCOREFILE_RECORD) != OK) return;
+		scorefile_unpack (&entry,req + 1);
+		if (entry.score > 0)
+		  {
+			 /* | and not ||, both of them have to see it */
+			 if ((scorefile_merge (scores,&entry) | rank (&entry)) && !dirty) dirty = time (NULL);
+			 leaderboard_standing (&board,&entry,&standing);
+		  }
+		else memset (&standing,0,sizeof (standing));
+		put32 (p,standing.rank);
+		put32 (p + 4,standing.count);
+		put32 (p + 8,(uint32_t) standing.best);
+		p += SCORESOCK_STANDING;
+	 }
+   else if (req[0] != SCORESOCK_QUERY) return;
+   answer[0] = SCORESOCK_OK;
+   for (i = 0; i < BIG_NUMSCORES; i++) scorefile_pack (answer + 1 + i * SCOREFILE_RECORD,&scores[i]);
+   scoresock_send (fd,answer,p - answer);
+}
+
+static void showhelp ()
+{
+   fprintf (stderr,"USAGE: notintd [-f scorefile] [-S socket] [-w seconds]\n");
+   fprintf (stderr,"  -f <file>    Score file (default %s)\n",conf_scorefile);
+   fprintf (stderr,"  -S <socket>  Socket to listen on (default: score file name + %s)\n",SCORESOCK_SUFFIX);
+   fprintf (stderr,"  -w <seconds> Wait this long after a new score to write the file (default %d)\n",WRITE_DELAY);
+   exit (EXIT_FAILURE);
+}
+
+static void parse_options (int argc,char *argv[])
+{
+   int i = 1;
+   while (i < argc)
+	 {
+		if (strcmp (argv[i],"-f") == 0)
+		  {
+			 if (++i >= argc) showhelp ();
+			 scorefile = argv[i];
+		  }
+		else if (strcmp (argv[i],"-S") == 0)
+		  {
+			 if (++i >= argc) showhelp ();
+			 scoresocket = argv[i];
+		  }
+		else if (strcmp (argv[i],"-w") == 0)
+		  {
+			 if (++i >= argc || !str2int (&write_delay,argv[i]) || write_delay < 0) showhelp ();
+		  }
+		else
+		  {
+			 fprintf (stderr,"Invalid option -- %s\n",argv[i]);
+			 showhelp ();
+		  }
+		i++;
+	 }
+
+   if (scorefile == NULL) scorefile = expand_path (conf_scorefile);
+   if (scorefile != NULL && scoresocket == NULL &&
+	   (scoresocket = malloc (strlen (scorefile) + strlen (SCORESOCK_SUFFIX) + 1)) != NULL)
+	 sprintf (scoresocket,"%s%s",scorefile,SCORESOCK_SUFFIX);
+   if (scorefile == NULL || scoresocket == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+}
+
+int main (int argc,char *argv[])
+{
+   struct sigaction sa;
+   struct pollfd pfd;
+   int fd,wait,lock;
+
+   parse_options (argc,argv);
+
+   /* nobody changes the files while we read them */
+   lock = scorefile_lock (scorefile);
+   scorefile_init (scores);
+   switch (scorefile_read (scorefile,scores))
+	 {
+	  case SCOREFILE_UNKNOWN:
+		fprintf (stderr,"notintd: %s is not a score file\n",scorefile);
+		exit (EXIT_FAILURE);
+	  case SCOREFILE_MISSING:
+	  case SCOREFILE_BAD:
+		/* it'll be started over with the first score */
+		scorefile_init (scores);
+		break;
+	 }
+   leaderboard_init (&board);
+   switch (leaderboard_load (&board,scorefile))
+	 {
+	  case ERR:
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	  case SCOREFILE_BAD:
+		/* start over with what we could find */
+		rebuild = TRUE;
+		dirty = time (NULL);
+		break;
+	 }
+   scorefile_unlock (lock);
+
+   if ((pfd.fd = scoresock_listen (scoresocket,scorefile)) < 0)
+	 {
+		fprintf (stderr,"notintd: cannot listen on %s (already running?)\n",scoresocket);
+		exit (EXIT_FAILURE);
+	 }
+   pfd.events = POLLIN;
+
+   memset (&sa,0,sizeof (sa));
+   sa.sa_handler = stop;		/* no SA_RESTART, so poll () gets interrupted */
+   sigaction (SIGINT,&sa,NULL);
+   sigaction (SIGTERM,&sa,NULL);
+   sigaction (SIGHUP,&sa,NULL);
+   signal (SIGPIPE,SIG_IGN);
+
+   while (!quit)
+	 {
+		/* sleep until a request comes in or it's time to write */
+		wait = -1;
+		if (dirty)
+		  {
+			 wait = (dirty + write_delay - time (NULL)) * 1000;
+			 if (wait < 0) wait = 0;
+		  }
+		if (poll (&pfd,1,wait) > 0 && (fd = accept (pfd.fd,NULL,NULL)) >= 0)
+		  {
+			 serve (fd);
+			 close (fd);
+		  }
+		if (dirty && time (NULL) >= dirty + write_delay) flush ();
+	 }
+
+   if (dirty) flush ();
+   close (pfd.fd);
+   unlink (scoresocket);
+   exit (EXIT_SUCCESS);
+}
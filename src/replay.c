@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "replay.h"
+
+/* Longest varint for a 64-bit value */
+#define VARINT_MAX	10
+
+/* Append v to buf as a varint, returns bytes used */
+static size_t putvarint (unsigned char *buf,uint64_t v)
+{
+   size_t n = 0;
+   while (v >= 0x80)
+	 {
+		buf[n++] = (unsigned char) (v | 0x80);
+		v >>= 7;
+	 }
+   buf[n++] = (unsigned char) v;
+   return n;
+}
+
+/* Read a varint, FALSE if the data runs out first */
+static bool getvarint (replay_reader_t *reader,uint64_t *v)
+{
+   int shift = 0;
+   unsigned char byte;
+   *v = 0;
+   do
+	 {
+		if (reader->pos >= reader->size || shift > 63) return FALSE;
+		byte = reader->data[reader->pos++];
+		*v |= (uint64_t) (byte & 0x7f) << shift;
+		shift += 7;
+	 }
+   while (byte & 0x80);
+   return TRUE;
+}
+
+static void flush (replay_writer_t *writer)
+{
+   size_t done = 0;
+   ssize_t n;
+   while (writer->fd >= 0 && done < writer->len)
+	 {
+		n = write (writer->fd,writer->buf + done,writer->len - done);
+		if (n <= 0)
+		  {
+			 /* give up on the recording, not the game */
+			 close (writer->fd);
+			 writer->fd = -1;
+			 break;
+		  }
+		done += n;
+	 }
+   writer->len = 0;
+}
+
+/*
+ * Create a replay file and write its header
+ */
+int replay_create (replay_writer_t *writer,const char *file,const replay_header_t *header)
+{
+   writer->fd = open (file,O_WRONLY | O_CREAT | O_TRUNC,0644);
+   if (writer->fd < 0) return ERR;
+   writer->last_ms = 0;
+   memcpy (writer->buf,REPLAY_MAGIC_NUMBER,strlen (REPLAY_MAGIC_NUMBER));
+   writer->len = strlen (REPLAY_MAGIC_NUMBER);
+   writer->len += putvarint (writer->buf + writer->len,header->seed);
+   writer->len += putvarint (writer->buf + writer->len,header->mode);
+   writer->len += putvarint (writer->buf + writer->len,header->level);
+   writer->len += putvarint (writer->buf + writer->len,header->flags);
+   flush (writer);
+   return writer->fd < 0 ? ERR : OK;
+}
+
+/*
+ * Add an event to the replay
+ */
+void replay_event (replay_writer_t *writer,long long ms,int event,int arg)
+{
+   uint64_t delta = ms > writer->last_ms ? ms - writer->last_ms : 0;
+   if (writer->len + 2 * VARINT_MAX > REPLAY_BUFSIZE) flush (writer);
+   writer->len += putvarint (writer->buf + writer->len,(delta << EVENT_BITS) | event);
+   if (event == EVENT_PAUSE || event == EVENT_OPTION)
+	 writer->len += putvarint (writer->buf + writer->len,arg);
+   writer->last_ms += delta;
+}
+
+/*
+ * Write out the buffer and close the file
+ */
+int replay_close (replay_writer_t *writer)
+{
+   flush (writer);
+   if (writer->fd < 0) return ERR;
+   if (close (writer->fd) != 0) return ERR;
+   writer->fd = -1;
+   return OK;
+}
+
+/*
+ * Read a replay file and its header
+ */
+int replay_open (replay_reader_t *reader,const char *file,replay_header_t *header)
+{
+   struct stat st;
+   uint64_t v[4];
+   size_t done = 0;
+   ssize_t n;
+   int fd,i;
+
+   reader->data = NULL;
+   if ((fd = open (file,O_RDONLY)) < 0) return ERR;
+   if (fstat (fd,&st) != 0 || (reader->data = malloc (st.st_size + 1)) == NULL)
+	 {
+		close (fd);
+		return ERR;
+	 }
+   reader->size = st.st_size;
+   while (done < reader->size)
+	 {
+		n = read (fd,reader->data + done,reader->size - done);
+		if (n <= 0) break;
+		done += n;
+	 }
+   close (fd);
+   reader->size = done;
+   reader->pos = strlen (REPLAY_MAGIC_NUMBER);
+   reader->ms = 0;
+   if (reader->size < reader->pos || memcmp (reader->data,REPLAY_MAGIC_NUMBER,reader->pos) != 0)
+	 {
+		replay_free (reader);
+		return ERR;
+	 }
+   for (i = 0; i < 4; i++)
+	 if (!getvarint (reader,&v[i]))
+	   {
+		  replay_free (reader);
+		  return ERR;
+	   }
+   /* a mode we don't know would index past the mode tables */
+   if (v[1] > MODE_HIGH)
+	 {
+		replay_free (reader);
+		return ERR;
+	 }
+   header->seed = v[0];
+   header->mode = (int) v[1];
+   header->level = (int) v[2];
+   header->flags = (int) v[3];
+   return OK;
+}
+
+/*
+ * Fetch the next event
+ */
+bool replay_next (replay_reader_t *reader,long long *ms,int *event,int *arg)
+{
+   uint64_t v,a = 0;
+   if (!getvarint (reader,&v)) return FALSE;
+   *event = (int) (v & ((1 << EVENT_BITS) - 1));
+   if ((*event == EVENT_PAUSE || *event == EVENT_OPTION) && !getvarint (reader,&a)) return FALSE;
+   reader->ms += (long long) (v >> EVENT_BITS);
+   *ms = reader->ms;
+   *arg = (int) a;
+   return TRUE;
+}
+
+/*
+ * Done with a replay
+ */
+void replay_free (replay_reader_t *reader)
+{
+   free (reader->data);
+   reader->data = NULL;
+}
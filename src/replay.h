@@ -0,0 +1,131 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * A replay is the seed and settings of a game followed by everything
+ * the player (and gravity) did, so the game can be played again move
+ * for move. After the header each event is one varint holding the
+ * milliseconds since the previous event shifted up by EVENT_BITS, with
+ * the event number in the low bits. EVENT_PAUSE and EVENT_OPTION are
+ * followed by one more varint.
+ */
+
+/*
+ * Macros
+ */
+
+/* Events; the first four are the same numbers as action_t */
+#define EVENT_LEFT	0
+#define EVENT_ROTATE	1
+#define EVENT_RIGHT	2
+#define EVENT_DROP	3
+#define EVENT_TICK	4	/* gravity, engine_evaluate () */
+#define EVENT_LEVEL	5	/* 'a': up a level (or wrap, in zen) */
+#define EVENT_PAUSE	6	/* then: seconds the game was paused */
+#define EVENT_OPTION	7	/* then: option key, 's' or 'd' */
+#define EVENT_BITS	3
+
+/* Header flags */
+#define REPLAY_SHOWNEXT		1
+#define REPLAY_DOTTEDLINES	2
+
+/* Bytes of events kept back before writing */
+#define REPLAY_BUFSIZE	4096
+
+/*
+ * Type definitions
+ */
+
+typedef struct
+{
+   uint64_t seed;		/* engine_init () seed */
+   int mode;			/* engine_tweak () mode */
+   int level;			/* engine_tweak () level */
+   int flags;			/* REPLAY_SHOWNEXT, REPLAY_DOTTEDLINES */
+} replay_header_t;
+
+typedef struct
+{
+   int fd;
+   long long last_ms;		/* time of the previous event */
+   size_t len;			/* bytes waiting in buf */
+   unsigned char buf[REPLAY_BUFSIZE];
+} replay_writer_t;
+
+typedef struct
+{
+   unsigned char *data;		/* whole file */
+   size_t size,pos;
+   long long ms;		/* time of the last event read */
+} replay_reader_t;
+
+/*
+ * Functions
+ */
+
+/*
+ * Create a replay file and write its header. Returns OK or ERR.
+ */
+int replay_create (replay_writer_t *writer,const char *file,const replay_header_t *header);
+
+/*
+ * Add an event that happened ms milliseconds into the game. arg is
+ * only used by EVENT_PAUSE and EVENT_OPTION. Only touches the disk
+ * when the buffer fills.
+ */
+void replay_event (replay_writer_t *writer,long long ms,int event,int arg);
+
+/*
+ * Write whatever is buffered and close the file. Returns OK or ERR
+ * (ERR if any write along the way failed).
+ */
+int replay_close (replay_writer_t *writer);
+
+/*
+ * Read a replay file and its header. Returns OK or ERR (ERR too if
+ * the header names a mode outside MODE_LOW..MODE_HIGH).
+ */
+int replay_open (replay_reader_t *reader,const char *file,replay_header_t *header);
+
+/*
+ * Fetch the next event. Returns FALSE at the end of the replay.
+ */
+bool replay_next (replay_reader_t *reader,long long *ms,int *event,int *arg);
+
+/*
+ * Done with a replay opened by replay_open ()
+ */
+void replay_free (replay_reader_t *reader);
+
+#endif	/* #ifndef REPLAY_H */
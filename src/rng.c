@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+#include "rng.h"
+
+/*
+ * Start the sequence for this seed. Equal seeds give equal games.
+ */
+void rng_seed (rng_t *rng,uint64_t seed)
+{
+   rng->state = 0;
+   rng_next (rng);
+   rng->state += seed;
+   rng_next (rng);
+}
+
+/*
+ * Fill buf with count 32-bit draws
+ */
+void rng_fill (rng_t *rng,uint32_t *buf,int count)
+{
+   uint64_t state = rng->state;
+   uint32_t xorshifted,rot;
+   int i;
+   for (i = 0; i < count; i++)
+	 {
+		xorshifted = (uint32_t) (((state >> 18) ^ state) >> 27);
+		rot = (uint32_t) (state >> 59);
+		buf[i] = (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+		state = state * RNG_MULTIPLIER + RNG_INCREMENT;
+	 }
+   rng->state = state;
+}
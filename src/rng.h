@@ -0,0 +1,96 @@
+#ifndef RNG_H
+#define RNG_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+/*
+ * A small, fast random number generator (PCG32, fixed stream) whose
+ * whole state lives in the caller, so every game has its own
+ * reproducible sequence and games on different threads never share
+ * anything.
+ */
+
+/*
+ * Type definitions
+ */
+
+typedef struct
+{
+   uint64_t state;
+} rng_t;
+
+/*
+ * Macros
+ */
+
+#define RNG_MULTIPLIER	6364136223846793005ULL
+#define RNG_INCREMENT	1442695040888963407ULL
+
+/* Map a 32-bit draw onto 0 .. range - 1 without a division */
+#define RNG_RANGE(draw,range)	((int) (((uint64_t) (draw) * (uint32_t) (range)) >> 32))
+
+/*
+ * Functions
+ */
+
+/*
+ * Next 32 random bits
+ */
+static inline uint32_t rng_next (rng_t *rng)
+{
+   uint64_t old = rng->state;
+   uint32_t xorshifted,rot;
+   rng->state = old * RNG_MULTIPLIER + RNG_INCREMENT;
+   xorshifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+   rot = (uint32_t) (old >> 59);
+   return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/*
+ * Random number in 0 .. range - 1
+ */
+static inline int rng_below (rng_t *rng,int range)
+{
+   return RNG_RANGE (rng_next (rng),range);
+}
+
+/*
+ * Start the sequence for this seed. Equal seeds give equal games.
+ */
+void rng_seed (rng_t *rng,uint64_t seed);
+
+/*
+ * Fill buf with count 32-bit draws, as if by calling rng_next () count
+ * times. Use RNG_RANGE () to bring each one into range.
+ */
+void rng_fill (rng_t *rng,uint32_t *buf,int count);
+
+#endif	/* #ifndef RNG_H */
@@ -0,0 +1,153 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "basic.h"
+#include "engine.h"
+
+/*
+ * Each time a shape comes to rest the score is updated:
+ * In traditional mode, by how far the piece fell.
+ * In easy-tris mode, you also get points for rows cleared.
+ * In zen mode, you only get points for rows cleared.
+ * In speed run mode, you get points for lines cleared per minute, zero for first ten lines and/or minute.
+ * In challenge mode there are point penalties for non-challenge rows cleared,
+ * and extra non-challenge mode blocks left over.
+ *
+ * The rules for each mode are inline functions here, so an engine that
+ * knows its mode can have them without testing for it (see
+ * engine_tweak ()); score_standard () picks the right one.
+ */
+
+/*
+ * Functions
+ */
+
+/* Take a shape's score, less the shownext and dottedlines penalties, and never go below 0 */
+static inline void score_add (engine_t *engine,int score,int bonus)
+{
+   if (engine->shownext) score /= SCORE_PENALTY;
+   if (engine->dottedlines) score /= SCORE_PENALTY;
+
+   engine->score += score + bonus;
+
+   /* be nice to challenge players */
+   if( engine->score < 0 ) { engine->score = 0; }
+}
+
+/* Tradional scoring: most points come from how far a piece fell */
+static inline void score_traditional (engine_t *engine)
+{
+   score_add (engine,SCOREVAL (engine->level * (engine->status.dropcount + 1)),0);
+}
+
+/* Easytris bonus for actually clearing some lines */
+static inline void score_easytris (engine_t *engine)
+{
+   score_add (engine,SCOREVAL (engine->level * (engine->status.dropcount + 1)),
+			  engine->level * engine->status.lastclear);
+}
+
+static inline void score_zen (engine_t *engine)
+{
+   /* score is saved at a multiple real value */
+   engine->score += SCOREVAL (engine->status.lastclear);
+}
+
+static inline void score_speed (engine_t *engine)
+{
+   int raw_score;
+   int multiplier = 60;
+
+   time_t run_time = engine_runtime (engine);
+
+   /* backwards from regular game because of how multipler gets
+	* used here.
+	*/
+   if (engine->shownext) multiplier *= SCORE_PENALTY;
+   if (engine->dottedlines) multiplier *= SCORE_PENALTY;
+
+   /* To discourage using pause: it 50% of pause counts towards
+	* your run time.
+	*/
+   run_time -= engine->accumulated_pause / 2;
+
+   if ((run_time < 60) || (engine->status.droppedlines < 10)) {
+	  raw_score = 0;
+   } else {
+	  raw_score = (engine->status.droppedlines * 60) / run_time;
+	  multiplier = run_time / multiplier;
+	  raw_score *= multiplier;
+   }
+
+   /* score is saved at a multiple real value */
+   engine->score = SCOREVAL (raw_score);
+}
+
+static inline void score_challenge (engine_t *engine)
+{
+   int score = 0;
+
+   /* Drop distance bonus only applies if line count is appropriate for
+	* that level in traditional.
+	*/
+   if ((10 * engine->level) > engine->status.droppedlines)
+	 {
+		score += SCOREVAL (engine->level * (engine->status.dropcount + 1));
+	 }
+
+   /* Penalty for clearing a line without any challenge blocks.
+	*/
+   if (engine->status.lastclear && (engine->status.challengeblocks == engine->status.challengeblocks_prev))
+	 {
+		score /= SCORE_PENALTY;
+	 }
+
+   /* Cleared this challenge level! */
+   if (0 == engine->status.challengeblocks)
+	 {
+		/* bonus for clearing all of the challenge blocks */
+		score += SCOREVAL (engine->level * engine->status.challengestart);
+		/* and penalty for any other blocks remaining */
+		score -= SCOREVAL (2 * engine->status.nonchallengeblocks);
+	 }
+
+   engine->status.challengeblocks_prev = engine->status.challengeblocks;
+   score_add (engine,score,0);
+}
+
+/*
+ * The scoring rules for every game mode, suitable for engine_init ().
+ * Called by the engine each time a shape comes to rest; uses only the
+ * engine (including its shownext and dottedlines penalties).
+ */
+void score_standard (engine_t *engine);
+
+#endif	/* #ifndef SCORE_H */
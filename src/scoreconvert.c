@@ -26,15 +26,29 @@
  * March 2018
  */
 
+/* for nftw () */
+#define _XOPEN_SOURCE 700
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define NEED_GAMETYPE
 
 #include "basic.h"
 #include "typedefs.h"
+#include "utils.h"
+#include "scorefile.h"
 
 /* Unix timestamps of (low) 1990-01-01 and (high) 2100-01-01.
  * Outside that range considered "insane". The NEW date is
@@ -346,9 +360,6 @@ void shownewscores (void) {
  * Returns 0 on error, and number of entries on success.
  */
 int savenewscores (char* scorefile) {
-	int i, rv;
-	FILE *handle;
-        char header[MAX_HEADER];
 	char confirm[NAMELEN];
 
 
@@ -359,34 +370,367 @@ int savenewscores (char* scorefile) {
 		return (0);
 	}
 
-	if ((handle = fopen (scorefile,"w")) == NULL) {
-		printf ("Open for write error to %s\n", scorefile);
-		return (0);
-	}
-        strcpy (header,SCORE_MAGIC_NUMBER);
-        rv = fwrite (header,strlen (SCORE_MAGIC_NUMBER),1,handle);
-	if (rv != 1) ERROR_OUT ();
-	for (i = 0; i < BIG_NUMSCORES; i++)
-	  {
-		rv = fwrite (new_scores[i].name,strlen (new_scores[i].name) + 1,1,handle);
-		if (rv != 1) ERROR_OUT ();
-		rv = fwrite (&(new_scores[i].score),sizeof (int),1,handle);
-		if (rv != 1) ERROR_OUT ();
-		rv = fwrite (&(new_scores[i].trad_mode),sizeof (int),1,handle);
-		if (rv != 1) ERROR_OUT ();
-		rv = fwrite (&(new_scores[i].timestamp),sizeof (time_t),1,handle);
-		if (rv != 1) ERROR_OUT ();
+	if (scorefile_write (scorefile,new_scores) != OK) ERROR_OUT ();
+	return (BIG_NUMSCORES);
+}
 
-	  }
+          /***************************************************************************/
+          /***************************************************************************/
+          /***************************************************************************/
+
+/*
+ * Batch mode: convert whole directories of score files without asking,
+ * on every core, and say what happened to each one. Every old format
+ * is a header and then records of a nul terminated name, an int score,
+ * an int mode (not in tint's) and a time_t; which size of time_t and
+ * which byte order the file was written with is worked out from what
+ * reads sanely, so files from other machines convert too.
+ */
+
+/* Old formats, newest first (the notint headers all start alike) */
+static const struct
+{
+   const char *name;
+   const char *header;
+   int count;			/* records */
+   bool modes;			/* records have a mode */
+} formats[] =
+{
+   { "notint-v4", SCORE_MAGIC_NUMBER_3, BIG_NUMSCORES, TRUE },
+   { "notint-v3", SCORE_MAGIC_NUMBER_2, BIG_NUMSCORES - NUMSCORES, TRUE },
+   { "notint-v2", SCORE_MAGIC_NUMBER_1, BIG_NUMSCORES - 2 * NUMSCORES, TRUE },
+   { "notint-v1", SCORE_HEADER, NUMSCORES, TRUE },
+   { "tint", SCORE_HEADER_TINT, NUMSCORES, FALSE },
+   { NULL, NULL, 0, FALSE }
+};
+
+/* What an old file may have been written with */
+static const struct
+{
+   const char *name;
+   int timesize;
+   bool bigendian;
+} layouts[] =
+{
+   { "time64-le", 8, FALSE },
+   { "time32-le", 4, FALSE },
+   { "time64-be", 8, TRUE },
+   { "time32-be", 4, TRUE },
+};
+#define NUMLAYOUTS	(sizeof (layouts) / sizeof (layouts[0]))
+
+/* One file to convert, and what became of it */
+typedef struct
+{
+   char *path;
+   const char *status;		/* converted, skipped or rejected */
+   const char *format;
+   const char *layout;
+   char detail[64];
+} job_t;
+
+static job_t *jobs = NULL;
+static int numjobs = 0,maxjobs = 0;
+static long next_job = 0;
+static const char *pattern = "*.scores";
+static bool dryrun = FALSE;
+static bool backup = TRUE;
+
+/* A size byte number in the given byte order */
+static int64_t getnum (const unsigned char *p,int size,bool bigendian)
+{
+   uint64_t v = 0;
+   int i;
+   for (i = 0; i < size; i++) v |= (uint64_t) p[bigendian ? size - 1 - i : i] << (8 * i);
+   /* sign extend */
+   if (size < 8 && (v >> (8 * size - 1)) & 1) v |= ~(uint64_t) 0 << (8 * size);
+   return (int64_t) v;
+}
+
+/*
+ * Read the records after the header with layout l. Only a layout that
+ * reads all of the file, with sane modes and dates, will do.
+ */
+static bool parse (const unsigned char *data,size_t size,int f,int l,score_t *entries)
+{
+   size_t pos = strlen (formats[f].header),need;
+   const unsigned char *end;
+   int i,timesize = layouts[l].timesize;
+   bool big = layouts[l].bigendian;
+
+   for (i = 0; i < formats[f].count; i++)
+	 {
+		end = memchr (data + pos,'\0',size - pos);
+		if (end == NULL || end - (data + pos) > NAMELEN - 2) return FALSE;
+		memcpy (entries[i].name,data + pos,end - (data + pos) + 1);
+		pos = end - data + 1;
+		need = (formats[f].modes ? 8 : 4) + timesize;
+		if (size - pos < need) return FALSE;
+		entries[i].score = getnum (data + pos,4,big);
+		pos += 4;
+		entries[i].trad_mode = GAME_TRADITIONAL;
+		if (formats[f].modes)
+		  {
+			 entries[i].trad_mode = getnum (data + pos,4,big);
+			 pos += 4;
+		  }
+		entries[i].timestamp = getnum (data + pos,timesize,big);
+		pos += timesize;
+		/* empty slots can hold anything */
+		if (entries[i].score > 0 &&
+			(entries[i].trad_mode < MODE_LOW || entries[i].trad_mode > MODE_HIGH ||
+			 entries[i].timestamp < SCORE_DATE_LOW || entries[i].timestamp > SCORE_DATE_HIGH))
+		  return FALSE;
+	 }
+   return pos == size;
+}
+
+/* Work out the format and layout, and convert into new_scores */
+static void convertfile (job_t *job,const unsigned char *data,size_t size,score_t *converted)
+{
+   score_t entries[BIG_NUMSCORES];
+   int f,l,found = -1,i;
+   bool host = (time_t) 1 == *(const unsigned char *) &(time_t) { 1 };
 
-        fclose (handle);
-	return (i);
+   for (f = 0; formats[f].name != NULL; f++)
+	 if (size >= strlen (formats[f].header) && memcmp (data,formats[f].header,strlen (formats[f].header)) == 0) break;
+   if (formats[f].name == NULL)
+	 {
+		job->status = size >= strlen (SCORE_MAGIC_NUMBER) &&
+		  memcmp (data,SCORE_MAGIC_NUMBER,strlen (SCORE_MAGIC_NUMBER)) == 0 ? "skipped" : "rejected";
+		strcpy (job->detail,*job->status == 's' ? "already version 5" : "not a score file");
+		return;
+	 }
+   job->format = formats[f].name;
+
+   /* if more than one layout reads sanely, the host's own wins */
+   for (l = 0; l < NUMLAYOUTS; l++)
+	 if (parse (data,size,f,l,entries))
+	   if (found < 0 || (layouts[l].timesize == sizeof (time_t) && layouts[l].bigendian != host)) found = l;
+   if (found < 0)
+	 {
+		job->status = "rejected";
+		strcpy (job->detail,"no time_t size or byte order reads it");
+		return;
+	 }
+   parse (data,size,f,found,entries);
+   job->layout = layouts[found].name;
+
+   scorefile_init (converted);
+   for (i = 0; i < formats[f].count; i++)
+	 if (entries[i].score > 0) scorefile_merge (converted,&entries[i]);
+   job->status = "converted";
+}
+
+/* Convert one file in place, keeping the old one as <file>.old */
+static void runjob (job_t *job)
+{
+   score_t converted[BIG_NUMSCORES],check[BIG_NUMSCORES];
+   unsigned char *data;
+   struct stat st;
+   char *old;
+   int fd,i;
+
+   job->format = job->layout = "-";
+   job->status = "rejected";
+   if ((fd = open (job->path,O_RDONLY)) < 0 || fstat (fd,&st) != 0 || !S_ISREG (st.st_mode))
+	 {
+		snprintf (job->detail,sizeof (job->detail),"%s",strerror (fd < 0 ? errno : EINVAL));
+		if (fd >= 0) close (fd);
+		return;
+	 }
+   if (st.st_size == 0 || (data = mmap (NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0)) == MAP_FAILED)
+	 {
+		strcpy (job->detail,"empty or unreadable");
+		close (fd);
+		return;
+	 }
+   close (fd);
+   convertfile (job,data,st.st_size,converted);
+   munmap (data,st.st_size);
+   if (*job->status != 'c' || dryrun) return;
+
+   /* the old one stays, under another name */
+   if (backup)
+	 {
+		if ((old = malloc (strlen (job->path) + 5)) == NULL)
+		  {
+			 job->status = "rejected";
+			 strcpy (job->detail,"out of memory");
+			 return;
+		  }
+		sprintf (old,"%s.old",job->path);
+		unlink (old);
+		if (link (job->path,old) != 0)
+		  {
+			 job->status = "rejected";
+			 snprintf (job->detail,sizeof (job->detail),"cannot keep %s.old",job->path);
+			 free (old);
+			 return;
+		  }
+		free (old);
+	 }
+   /* written next to it and renamed over it */
+   if (scorefile_write (job->path,converted) != OK)
+	 {
+		job->status = "rejected";
+		strcpy (job->detail,"write failed");
+		return;
+	 }
+   /* root converting players' files mustn't end up owning them */
+   if (chown (job->path,st.st_uid,st.st_gid) != 0 && geteuid () == 0)
+	 strcpy (job->detail,"cannot restore owner, ");
+   /* and it must read back as what we wrote */
+   scorefile_init (check);
+   if (scorefile_read (job->path,check) != 5)
+	 {
+		job->status = "rejected";
+		strcpy (job->detail,"does not read back");
+		return;
+	 }
+   for (i = 0; i < BIG_NUMSCORES; i++)
+	 if (strcmp (check[i].name,converted[i].name) != 0 || check[i].score != converted[i].score ||
+		 check[i].trad_mode != converted[i].trad_mode || check[i].timestamp != converted[i].timestamp)
+	   {
+		  job->status = "rejected";
+		  strcpy (job->detail,"reads back different");
+		  return;
+	   }
+   strcat (job->detail,"verified");
+}
+
+static void *worker (void *arg)
+{
+   long i;
+   while ((i = __sync_fetch_and_add (&next_job,1)) < numjobs) runjob (&jobs[i]);
+   return NULL;
+}
+
+static void addjob (const char *path)
+{
+   job_t *more;
+   if (numjobs == maxjobs)
+	 {
+		maxjobs = maxjobs ? 2 * maxjobs : 256;
+		if ((more = realloc (jobs,maxjobs * sizeof (job_t))) == NULL)
+		  {
+			 fputs ("Out of memory\n",stderr);
+			 exit (EXIT_FAILURE);
+		  }
+		jobs = more;
+	 }
+   memset (&jobs[numjobs],0,sizeof (job_t));
+   if ((jobs[numjobs++].path = strdup (path)) == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+}
+
+/* Files in the directories looked through, if their names match */
+static int scanned (const char *path,const struct stat *st,int type,struct FTW *ftw)
+{
+   if (type == FTW_F && S_ISREG (st->st_mode) && fnmatch (pattern,path + ftw->base,0) == 0)
+	 addjob (path);
+   return 0;
+}
+
+static void addpath (const char *path)
+{
+   struct stat st;
+   if (stat (path,&st) == 0 && S_ISDIR (st.st_mode))
+	 {
+		if (nftw (path,scanned,16,FTW_PHYS) != 0) fprintf (stderr,"scoreconvert: cannot scan %s\n",path);
+	 }
+   else addjob (path);
+}
+
+static void batchhelp ()
+{
+   fprintf (stderr,"USAGE: scoreconvert OLDFILE NEWFILE\n");
+   fprintf (stderr,"or   : scoreconvert -b [-j jobs] [-p pattern] [-l list] [-n] [-k] path ...\n");
+   fprintf (stderr,"  -b           Convert every score file given, in place, without asking\n");
+   fprintf (stderr,"  -j <jobs>    Files to convert at once (default: one per core)\n");
+   fprintf (stderr,"  -p <pattern> Files to pick in directories (default %s)\n",pattern);
+   fprintf (stderr,"  -l <list>    Also convert the paths in this file, one a line (- for stdin)\n");
+   fprintf (stderr,"  -n           Only check what would happen, write nothing\n");
+   fprintf (stderr,"  -k           Don't keep the old files as <file>.old\n");
+   fprintf (stderr,"Directories are looked through for files matching the pattern.\n");
+   fprintf (stderr,"Prints a line per file: converted, skipped or rejected, path,\n");
+   fprintf (stderr,"format, layout and detail, separated by tabs, then the totals.\n");
+   exit (EXIT_FAILURE);
+}
+
+static int batch (int argc,char **argv)
+{
+   pthread_t *threads;
+   char line[4096];
+   FILE *list;
+   int i,numthreads = sysconf (_SC_NPROCESSORS_ONLN),count[3] = { 0, 0, 0 };
+
+   for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+	 {
+		if (strcmp (argv[i],"-j") == 0)
+		  {
+			 if (++i >= argc || !str2int (&numthreads,argv[i]) || numthreads < 1) batchhelp ();
+		  }
+		else if (strcmp (argv[i],"-p") == 0)
+		  {
+			 if (++i >= argc) batchhelp ();
+			 pattern = argv[i];
+		  }
+		else if (strcmp (argv[i],"-l") == 0)
+		  {
+			 if (++i >= argc) batchhelp ();
+			 if ((list = strcmp (argv[i],"-") == 0 ? stdin : fopen (argv[i],"r")) == NULL)
+			   {
+				  fprintf (stderr,"scoreconvert: cannot read %s\n",argv[i]);
+				  exit (EXIT_FAILURE);
+			   }
+			 while (fgets (line,sizeof (line),list) != NULL)
+			   {
+				  line[strcspn (line,"\n")] = '\0';
+				  if (line[0] != '\0') addpath (line);
+			   }
+			 if (list != stdin) fclose (list);
+		  }
+		else if (strcmp (argv[i],"-n") == 0)
+		  dryrun = TRUE;
+		else if (strcmp (argv[i],"-k") == 0)
+		  backup = FALSE;
+		else batchhelp ();
+	 }
+   for ( ; i < argc; i++) addpath (argv[i]);
+   if (numjobs == 0) batchhelp ();
+
+   if (numthreads < 1) numthreads = 1;
+   if (numthreads > numjobs) numthreads = numjobs;
+   if ((threads = malloc (numthreads * sizeof (pthread_t))) == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+   for (i = 0; i < numthreads; i++) pthread_create (&threads[i],NULL,worker,NULL);
+   for (i = 0; i < numthreads; i++) pthread_join (threads[i],NULL);
+
+   for (i = 0; i < numjobs; i++)
+	 {
+		printf ("%s\t%s\t%s\t%s\t%s\n",jobs[i].status,jobs[i].path,jobs[i].format,jobs[i].layout,
+				jobs[i].detail[0] != '\0' ? jobs[i].detail : dryrun ? "not written" : "-");
+		count[*jobs[i].status == 'c' ? 0 : *jobs[i].status == 's' ? 1 : 2]++;
+	 }
+   printf ("total\tconverted=%d\tskipped=%d\trejected=%d\n",count[0],count[1],count[2]);
+   return count[2] ? 1 : 0;
 }
 
 int main (int argc, char**argv)
 {
+    if (argc > 1 && 0 == strcmp (argv[1], "-b")) {
+	return (batch (argc, argv));
+    }
     if (argc != 3) {
 	printf ("%s: usage scoreconvert OLDFILE NEWFILE\n", argv[0]);
+	printf ("%s: or    scoreconvert -b [options] path ... (-b -h for help)\n", argv[0]);
 	return (1);
     }
     initscores ();
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "scorefile.h"
+
+void scorefile_init (score_t scores[BIG_NUMSCORES])
+{
+   int i, mode;
+   mode = MODE_LOW - 1;
+
+   for (i = 0; i < BIG_NUMSCORES; i++)
+	 {
+		if(0 == (i % NUMSCORES)) {
+			mode ++;
+		}
+		strcpy (scores[i].name,"None");
+		scores[i].score = -1;
+   		scores[i].trad_mode = mode;
+		scores[i].timestamp = 0;
+	 }
+}
+
+/* Order of the scores in the file: by mode, best first, oldest first */
+static int cmpscores (const void *a,const void *b)
+{
+   int result, av, bv;
+   time_t result_time, at, bt;
+
+   av = (int) ((score_t *) a)->trad_mode;
+   bv = (int) ((score_t *) b)->trad_mode;
+   result = av - bv;
+
+   /* (REVERSE) Sort by gamemmode first */
+   /* a < b */
+   if (result < 0) return -1;
+   /* a > b */
+   if (result > 0) return 1;
+   /* a = b */
+
+   /* Then by score */
+   av = (int) ((score_t *) a)->score;
+   bv = (int) ((score_t *) b)->score;
+   result = av - bv;
+
+   /* a < b */
+   if (result < 0) return 1;
+   /* a > b */
+   if (result > 0) return -1;
+   /* a = b */
+
+   /* Then by timestamp (REVERSE again) */
+   at = (int) ((score_t *) a)->timestamp;
+   bt = (int) ((score_t *) b)->timestamp;
+   result_time = at - bt;
+
+   /* a is older */
+   if (result_time < 0) return -1;
+   /* b is older */
+   if (result_time > 0) return 1;
+   /* timestamps is equal */
+   return 0;
+}
+
+uint32_t scorefile_checksum (const unsigned char *p,size_t len)
+{
+   uint32_t sum = 2166136261U;
+   while (len--) sum = (sum ^ *p++) * 16777619U;
+   return sum;
+}
+
+void scorefile_pack (unsigned char *rec,const score_t *score)
+{
+   memset (rec,0,SCOREFILE_RECORD);
+   strncpy ((char *) rec + SCOREFILE_NAME,score->name,NAMELEN - 1);
+   put32 (rec + SCOREFILE_SCORE,(uint32_t) score->score);
+   put32 (rec + SCOREFILE_MODE,(uint32_t) score->trad_mode);
+   put64 (rec + SCOREFILE_TIME,(uint64_t) (int64_t) score->timestamp);
+}
+
+void scorefile_unpack (score_t *score,const unsigned char *rec)
+{
+   memcpy (score->name,rec + SCOREFILE_NAME,NAMELEN);
+   score->name[NAMELEN - 1] = '\0';
+   score->score = (int32_t) get32 (rec + SCOREFILE_SCORE);
+   score->trad_mode = (int32_t) get32 (rec + SCOREFILE_MODE);
+   score->timestamp = (time_t) (int64_t) get64 (rec + SCOREFILE_TIME);
+}
+
+/* Version 5: fixed records */
+static int read_v5 (const unsigned char *data,size_t size,score_t *scores)
+{
+   const unsigned char *rec = data + SCOREFILE_HEADER;
+   uint32_t count,i;
+
+   if (size < SCOREFILE_HEADER) return SCOREFILE_BAD;
+   count = get32 (data + SCOREFILE_HEADER - 8);
+   if (count > BIG_NUMSCORES || size < SCOREFILE_HEADER + count * SCOREFILE_RECORD)
+	 return SCOREFILE_BAD;
+   if (get32 (data + SCOREFILE_HEADER - 4) != scorefile_checksum (rec,count * SCOREFILE_RECORD))
+	 return SCOREFILE_BAD;
+   for (i = 0; i < count; i++, rec += SCOREFILE_RECORD) scorefile_unpack (&scores[i],rec);
+   return OK;
+}
+
+/*
+ * Versions 2 to 4: each record is a nul terminated name and then the
+ * host's int score, int mode and time_t timestamp
+ */
+static int read_old (const unsigned char *data,size_t size,score_t *scores,int count)
+{
+   size_t pos = strlen (SCORE_MAGIC_NUMBER);
+   const unsigned char *end;
+   int i;
+
+   for (i = 0; i < count; i++)
+	 {
+		end = memchr (data + pos,'\0',size - pos);
+		if (end == NULL || end - (data + pos) > NAMELEN - 2) return SCOREFILE_BAD;
+		memcpy (scores[i].name,data + pos,end - (data + pos) + 1);
+		pos = end - data + 1;
+		if (size - pos < 2 * sizeof (int) + sizeof (time_t)) return SCOREFILE_BAD;
+		memcpy (&scores[i].score,data + pos,sizeof (int));
+		pos += sizeof (int);
+		memcpy (&scores[i].trad_mode,data + pos,sizeof (int));
+		pos += sizeof (int);
+		memcpy (&scores[i].timestamp,data + pos,sizeof (time_t));
+		pos += sizeof (time_t);
+	 }
+   return OK;
+}
+
+int scorefile_read (const char *file,score_t scores[BIG_NUMSCORES])
+{
+   struct stat st;
+   unsigned char *data;
+   size_t size,len = strlen (SCORE_MAGIC_NUMBER);
+   int fd,result;
+
+   if ((fd = open (file,O_RDONLY)) < 0) return SCOREFILE_MISSING;
+   if (fstat (fd,&st) != 0 || st.st_size < len)
+	 {
+		close (fd);
+		return SCOREFILE_BAD;
+	 }
+   size = st.st_size;
+   data = mmap (NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+   close (fd);
+   if (data == MAP_FAILED) return SCOREFILE_BAD;
+
+   /* all the magic numbers have the same length by design */
+   if (memcmp (data,SCORE_MAGIC_NUMBER,len) == 0)
+	 result = read_v5 (data,size,scores) == OK ? 5 : SCOREFILE_BAD;
+   else if (memcmp (data,SCORE_MAGIC_NUMBER_3,len) == 0)
+	 /* trad, easy, zen, challenge, and speed */
+	 result = read_old (data,size,scores,BIG_NUMSCORES) == OK ? 4 : SCOREFILE_BAD;
+   else if (memcmp (data,SCORE_MAGIC_NUMBER_2,len) == 0)
+	 /* trad, easy, zen, and challenge but no speed */
+	 result = read_old (data,size,scores,BIG_NUMSCORES - NUMSCORES) == OK ? 3 : SCOREFILE_BAD;
+   else if (memcmp (data,SCORE_MAGIC_NUMBER_1,len) == 0)
+	 /* trad, easy, and zen but no challenge or speed */
+	 result = read_old (data,size,scores,BIG_NUMSCORES - 2 * NUMSCORES) == OK ? 2 : SCOREFILE_BAD;
+   else
+	 result = SCOREFILE_UNKNOWN;
+
+   munmap (data,size);
+   return result;
+}
+
+/* Write all of buf to fd */
+static int write_all (int fd,const unsigned char *buf,size_t len)
+{
+   ssize_t n;
+   while (len > 0)
+	 {
+		if ((n = write (fd,buf,len)) <= 0) return ERR;
+		buf += n;
+		len -= n;
+	 }
+   return OK;
+}
+
+int scorefile_writenew (const char *file,const void *buf,size_t len)
+{
+   char *temp;
+   struct stat st;
+   int fd,result = ERR;
+
+   if ((temp = malloc (strlen (file) + 5)) == NULL) return ERR;
+   sprintf (temp,"%s.new",file);
+   if ((fd = open (temp,O_WRONLY | O_CREAT | O_TRUNC,0644)) >= 0)
+	 {
+		/* keep the old file's permissions, it may be shared by a group */
+		if (stat (file,&st) == 0) fchmod (fd,st.st_mode & 07777);
+		result = write_all (fd,buf,len);
+		if (fsync (fd) != 0) result = ERR;
+		if (close (fd) != 0) result = ERR;
+		if (result != OK) unlink (temp);
+	 }
+   free (temp);
+   return result;
+}
+
+int scorefile_replace (const char *file,const void *buf,size_t len)
+{
+   char *temp;
+   int result;
+
+   if ((temp = malloc (strlen (file) + 5)) == NULL) return ERR;
+   sprintf (temp,"%s.new",file);
+   if ((result = scorefile_writenew (file,buf,len)) == OK && rename (temp,file) != 0)
+	 {
+		unlink (temp);
+		result = ERR;
+	 }
+   free (temp);
+   return result;
+}
+
+int scorefile_write (const char *file,const score_t scores[BIG_NUMSCORES])
+{
+   unsigned char buf[SCOREFILE_HEADER + BIG_NUMSCORES * SCOREFILE_RECORD];
+   unsigned char *rec = buf + SCOREFILE_HEADER;
+   int i;
+
+   memset (buf,0,sizeof (buf));
+   memcpy (buf,SCORE_MAGIC_NUMBER,strlen (SCORE_MAGIC_NUMBER));
+   for (i = 0; i < BIG_NUMSCORES; i++, rec += SCOREFILE_RECORD) scorefile_pack (rec,&scores[i]);
+   put32 (buf + SCOREFILE_HEADER - 8,BIG_NUMSCORES);
+   put32 (buf + SCOREFILE_HEADER - 4,scorefile_checksum (buf + SCOREFILE_HEADER,BIG_NUMSCORES * SCOREFILE_RECORD));
+   return scorefile_replace (file,buf,sizeof (buf));
+}
+
+/*
+ * That's a lock on <file>.lock, never on the score file itself: that
+ * one gets renamed over, and the next writer would lock the new file.
+ */
+int scorefile_lock (const char *file)
+{
+   char *name;
+   int fd;
+
+   if ((name = malloc (strlen (file) + 6)) == NULL) return ERR;
+   sprintf (name,"%s.lock",file);
+   /* flock () is happy with a read only descriptor */
+   fd = open (name,O_RDONLY | O_CREAT,0644);
+   free (name);
+   if (fd < 0) return ERR;
+   while (flock (fd,LOCK_EX) != 0)
+	 if (errno != EINTR)
+	   {
+		  close (fd);
+		  return ERR;
+	   }
+   return fd;
+}
+
+bool scorefile_merge (score_t scores[BIG_NUMSCORES],const score_t *entry)
+{
+   /* last score for the mode */
+   int i,offset = (entry->trad_mode + 1) * NUMSCORES - 1;
+
+   if (entry->trad_mode < MODE_LOW || entry->trad_mode > MODE_HIGH) return FALSE;
+   if (entry->score <= scores[offset].score) return FALSE;
+   for (i = offset + 1 - NUMSCORES; i <= offset; i++)
+	 if (cmpscores (&scores[i],entry) == 0 && strcmp (scores[i].name,entry->name) == 0) return FALSE;
+   scores[offset] = *entry;
+   qsort (scores,BIG_NUMSCORES,sizeof (score_t),cmpscores);
+   return TRUE;
+}
+
+void scorefile_unlock (int fd)
+{
+   /* closing it lets go of the lock */
+   if (fd >= 0) close (fd);
+}
+
+int scorefile_add (const char *file,const score_t *entries,int count,score_t scores[BIG_NUMSCORES])
+{
+   int i,fd,result = OK;
+   bool changed = FALSE;
+
+   fd = scorefile_lock (file);
+   scorefile_init (scores);
+   switch (scorefile_read (file,scores))
+	 {
+	  case SCOREFILE_UNKNOWN:
+		result = SCOREFILE_UNKNOWN;
+		break;
+	  case SCOREFILE_MISSING:
+	  case SCOREFILE_BAD:
+		/* start over */
+		scorefile_init (scores);
+		/* and carry on as if it was empty */
+	  default:
+		for (i = 0; i < count; i++) changed |= scorefile_merge (scores,&entries[i]);
+		if (changed) result = scorefile_write (file,scores);
+	 }
+   scorefile_unlock (fd);
+   return result;
+}
@@ -0,0 +1,171 @@
+#ifndef SCOREFILE_H
+#define SCOREFILE_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "typedefs.h"		/* score_t */
+#include "basic.h"		/* BIG_NUMSCORES */
+
+/*
+ * The high score file. The current format (version 5) is the
+ * SCORE_MAGIC_NUMBER header followed by the number of records and a
+ * checksum of them, then that many fixed size records. Every number is
+ * little-endian and of a fixed width, so a score file can be copied
+ * between machines. Older formats (versions 2 to 4, which were written
+ * with the host's int and time_t) can still be read, and are replaced
+ * by version 5 the next time the file is saved.
+ */
+
+/*
+ * Macros
+ */
+
+/* One record: name, int32 score, int32 mode, int64 timestamp */
+#define SCOREFILE_NAME		0
+#define SCOREFILE_SCORE		(SCOREFILE_NAME + NAMELEN)
+#define SCOREFILE_MODE		(SCOREFILE_SCORE + 4)
+#define SCOREFILE_TIME		(SCOREFILE_MODE + 4)
+#define SCOREFILE_RECORD	(SCOREFILE_TIME + 8)
+
+/* After the magic number: uint32 record count, uint32 checksum */
+#define SCOREFILE_HEADER	(sizeof (SCORE_MAGIC_NUMBER) - 1 + 8)
+
+/* scorefile_read () failures */
+#define SCOREFILE_MISSING	-1	/* can't open it */
+#define SCOREFILE_BAD		-2	/* short, or doesn't add up */
+#define SCOREFILE_UNKNOWN	-3	/* not a score file we know */
+
+/*
+ * Functions
+ */
+
+/* Little-endian numbers, whatever the host is */
+static inline void put32 (unsigned char *p,uint32_t v)
+{
+   p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static inline void put64 (unsigned char *p,uint64_t v)
+{
+   put32 (p,(uint32_t) v);
+   put32 (p + 4,(uint32_t) (v >> 32));
+}
+
+static inline uint32_t get32 (const unsigned char *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t get64 (const unsigned char *p)
+{
+   return get32 (p) | ((uint64_t) get32 (p + 4) << 32);
+}
+
+/*
+ * Blank score lists: "None", score -1 and no date, in every mode
+ */
+void scorefile_init (score_t scores[BIG_NUMSCORES]);
+
+/*
+ * One score to or from a version 5 record of SCOREFILE_RECORD bytes
+ */
+void scorefile_pack (unsigned char *rec,const score_t *score);
+void scorefile_unpack (score_t *score,const unsigned char *rec);
+
+/*
+ * Put entry in the list for its mode, if it's good enough and not
+ * there already, keeping the lists in order. Returns TRUE if it went in.
+ */
+bool scorefile_merge (score_t scores[BIG_NUMSCORES],const score_t *entry);
+
+/*
+ * Read a score file, of any version we know, into scores. Score lists
+ * an older version didn't have are left as initialized by the caller.
+ *
+ * OUTPUT:
+ *   version of the file (2 to 5), or one of SCOREFILE_MISSING,
+ *   SCOREFILE_BAD or SCOREFILE_UNKNOWN
+ */
+int scorefile_read (const char *file,score_t scores[BIG_NUMSCORES]);
+
+/*
+ * Write scores out as a version 5 score file. A new file is written
+ * next to the old one and renamed over it, so the score file is never
+ * left half written. That takes a directory the game may create files
+ * in; a shared score file gets one of its own (see debian/postinst).
+ * Returns OK or ERR.
+ */
+int scorefile_write (const char *file,const score_t scores[BIG_NUMSCORES]);
+
+/*
+ * Replace file with len bytes from buf, the way scorefile_write () does.
+ * Returns OK or ERR.
+ */
+int scorefile_replace (const char *file,const void *buf,size_t len);
+
+/*
+ * The first half of that: write len bytes from buf to <file>.new, with
+ * file's permissions, for the caller to rename over file when it's
+ * ready. Returns OK, or ERR if it couldn't be created or written (and
+ * then there's no <file>.new).
+ */
+int scorefile_writenew (const char *file,const void *buf,size_t len);
+
+/*
+ * Checksum of the records in a version 5 file (FNV-1a, enough to
+ * notice a damaged file)
+ */
+uint32_t scorefile_checksum (const unsigned char *p,size_t len);
+
+/*
+ * Take the writers' lock for file, waiting for whoever has it. Returns
+ * a handle for scorefile_unlock (), or ERR if there's nothing we can
+ * lock (so nothing we could write either).
+ */
+int scorefile_lock (const char *file);
+void scorefile_unlock (int lock);
+
+/*
+ * Merge count entries into the file (see scorefile_merge ()) and save
+ * it. Only one process at a time gets to do this: the file is read
+ * again, merged and written while holding a lock, so scores saved by
+ * games that end together all get in. Readers never wait, as the file
+ * is replaced in one go (see scorefile_write ()). An unreadable file is
+ * started over. scores gets the lists as saved.
+ *
+ * OUTPUT:
+ *   OK, ERR if the file couldn't be written, or SCOREFILE_UNKNOWN
+ *   (and the file is left alone) if it isn't a score file we know
+ */
+int scorefile_add (const char *file,const score_t *entries,int count,score_t scores[BIG_NUMSCORES]);
+
+#endif	/* #ifndef SCOREFILE_H */
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "scorefile.h"
+#include "leaderboard.h"
+#include "scoresock.h"
+
+static int address (struct sockaddr_un *sun,const char *path)
+{
+   memset (sun,0,sizeof (*sun));
+   sun->sun_family = AF_UNIX;
+   if (strlen (path) >= sizeof (sun->sun_path)) return ERR;
+   strcpy (sun->sun_path,path);
+   return OK;
+}
+
+int scoresock_send (int fd,const void *buf,size_t len)
+{
+   const char *p = buf;
+   ssize_t n;
+   while (len > 0)
+	 {
+		if ((n = send (fd,p,len,0)) < 0 && errno == EINTR) continue;
+		if (n <= 0) return ERR;
+		p += n;
+		len -= n;
+	 }
+   return OK;
+}
+
+int scoresock_recv (int fd,void *buf,size_t len)
+{
+   char *p = buf;
+   ssize_t n;
+   while (len > 0)
+	 {
+		if ((n = recv (fd,p,len,0)) < 0 && errno == EINTR) continue;
+		if (n <= 0) return ERR;
+		p += n;
+		len -= n;
+	 }
+   return OK;
+}
+
+/*
+ * Send a request (len bytes of it) and read the answer into scores,
+ * and standing if there is one
+ */
+static int request (const char *path,const unsigned char *req,size_t len,score_t *scores,standing_t *standing)
+{
+   struct sockaddr_un sun;
+   struct timeval tv;
+   unsigned char answer[1 + BIG_NUMSCORES * SCOREFILE_RECORD + SCORESOCK_STANDING];
+   unsigned char *p = answer + 1 + BIG_NUMSCORES * SCOREFILE_RECORD;
+   int i,fd,result = ERR;
+
+   if (address (&sun,path) != OK) return ERR;
+   if ((fd = socket (AF_UNIX,SOCK_STREAM,0)) < 0) return ERR;
+   /* a stuck notintd mustn't hang the game */
+   tv.tv_sec = SCORESOCK_TIMEOUT;
+   tv.tv_usec = 0;
+   setsockopt (fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof (tv));
+   setsockopt (fd,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof (tv));
+   if (connect (fd,(struct sockaddr *) &sun,sizeof (sun)) == 0 &&
+	   scoresock_send (fd,req,len) == OK &&
+	   scoresock_recv (fd,answer,p - answer) == OK &&
+	   answer[0] == SCORESOCK_OK &&
+	   (standing == NULL || scoresock_recv (fd,p,SCORESOCK_STANDING) == OK))
+	 {
+		for (i = 0; i < BIG_NUMSCORES; i++)
+		  scorefile_unpack (&scores[i],answer + 1 + i * SCOREFILE_RECORD);
+		if (standing != NULL)
+		  {
+			 standing->rank = get32 (p);
+			 standing->count = get32 (p + 4);
+			 standing->best = (int32_t) get32 (p + 8);
+		  }
+		result = OK;
+	 }
+   close (fd);
+   return result;
+}
+
+int scoresock_query (const char *path,score_t scores[BIG_NUMSCORES])
+{
+   unsigned char req = SCORESOCK_QUERY;
+   return request (path,&req,1,scores,NULL);
+}
+
+int scoresock_submit (const char *path,const score_t *entry,score_t scores[BIG_NUMSCORES],standing_t *standing)
+{
+   unsigned char req[1 + SCOREFILE_RECORD];
+   req[0] = SCORESOCK_SUBMIT;
+   scorefile_pack (req + 1,entry);
+   return request (path,req,sizeof (req),scores,standing);
+}
+
+int scoresock_listen (const char *path,const char *file)
+{
+   struct sockaddr_un sun;
+   struct stat st;
+   mode_t mask;
+   int fd;
+
+   if (address (&sun,path) != OK) return ERR;
+   if ((fd = socket (AF_UNIX,SOCK_STREAM,0)) < 0) return ERR;
+   /* somebody's already serving it */
+   if (connect (fd,(struct sockaddr *) &sun,sizeof (sun)) == 0)
+	 {
+		close (fd);
+		return ERR;
+	 }
+   close (fd);
+   if ((fd = socket (AF_UNIX,SOCK_STREAM,0)) < 0) return ERR;
+   /* left over from a notintd that didn't get to clean up */
+   unlink (path);
+   /* nobody else can connect until it's set up below */
+   mask = umask (0177);
+   if (bind (fd,(struct sockaddr *) &sun,sizeof (sun)) != 0 || listen (fd,SOMAXCONN) != 0)
+	 {
+		umask (mask);
+		close (fd);
+		return ERR;
+	 }
+   umask (mask);
+   /* whoever may write the score file may send scores, nobody else */
+   if (stat (file,&st) != 0)
+	 {
+		st.st_gid = getegid ();
+		st.st_mode = 0660;
+	 }
+   if (chown (path,-1,st.st_gid) != 0) st.st_mode &= ~0070;
+   chmod (path,0600 | (st.st_mode & 0060));
+   return fd;
+}
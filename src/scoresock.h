@@ -0,0 +1,94 @@
+#ifndef SCORESOCK_H
+#define SCORESOCK_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "typedefs.h"		/* score_t */
+#include "basic.h"		/* BIG_NUMSCORES */
+#include "leaderboard.h"	/* standing_t */
+
+/*
+ * Talking to notintd, which keeps the high scores in memory and serves
+ * them over a Unix socket. A request is one byte, SCORESOCK_QUERY or
+ * SCORESOCK_SUBMIT, the latter followed by one score as a version 5
+ * record (see scorefile.h). The answer is SCORESOCK_OK followed by all
+ * BIG_NUMSCORES records as they are after the request, and for a
+ * submitted score where it stands on the leaderboard (see
+ * leaderboard.h): uint32 rank, uint32 count and int32 the player's
+ * best, little-endian. One request per connection.
+ */
+
+/*
+ * Macros
+ */
+
+#define SCORESOCK_QUERY		'Q'
+#define SCORESOCK_SUBMIT	'S'
+#define SCORESOCK_OK		'+'
+
+/* Size of the standing at the end of a submit's answer */
+#define SCORESOCK_STANDING	12
+
+/* Suffix added to the score file's name for the socket's */
+#define SCORESOCK_SUFFIX	".sock"
+
+/* How long either side waits on the other, in seconds */
+#define SCORESOCK_TIMEOUT	2
+
+/*
+ * Functions
+ */
+
+/*
+ * Fetch all the scores from the notintd listening on path. Returns OK,
+ * or ERR if there's no notintd there (use the score file instead).
+ */
+int scoresock_query (const char *path,score_t scores[BIG_NUMSCORES]);
+
+/*
+ * Hand a score to notintd, and get back all the scores with it merged
+ * in and where it stands. Returns OK, or ERR if there's no notintd there.
+ */
+int scoresock_submit (const char *path,const score_t *entry,score_t scores[BIG_NUMSCORES],standing_t *standing);
+
+/*
+ * Set up the listening socket for notintd, serving the score file file.
+ * Only those who may write the score file may connect: the socket gets
+ * its group, and is 0660 if the file is group writable, 0600 if not.
+ * Returns it, or ERR.
+ */
+int scoresock_listen (const char *path,const char *file);
+
+/*
+ * Send, or receive, exactly len bytes on a socket. Returns OK or ERR.
+ */
+int scoresock_send (int fd,const void *buf,size_t len);
+int scoresock_recv (int fd,void *buf,size_t len);
+
+#endif	/* #ifndef SCORESOCK_H */
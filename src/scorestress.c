@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * scorestress: forks lots of games that all save their scores to one
+ * score file and its leaderboard at the same moment, with readers going
+ * through the score file all the while, then checks that the file has
+ * the best scores of every mode, that the leaderboard has every score,
+ * and that nothing went missing along the way.
+ *
+ *   scorestress [file]
+ *
+ * Exits 0 if all is well. The file (default notint-stress.scores in
+ * the current directory) and its leaderboard are started over and left
+ * behind afterwards. "make stress-shared" runs it in a directory laid
+ * out like an installed shared score file (see debian/postinst).
+ * Run it somewhere the file's directory isn't writable to try the way
+ * score files are rewritten in place.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "scorefile.h"
+#include "leaderboard.h"
+
+#define WRITERS		64	/* games ending at once */
+#define ENTRIES		96	/* scores each of them saves, one at a time */
+#define READERS		4	/* and people looking at the scores meanwhile */
+
+/* Score n of writer w; all different, spread over the modes */
+static void entry (score_t *score,int w,int n)
+{
+   memset (score,0,sizeof (score_t));
+   snprintf (score->name,NAMELEN,"writer %d",w);
+   score->score = 1 + n * WRITERS + w;
+   score->trad_mode = (w + n) % GAME_MODE_COUNT;
+   score->timestamp = 685080000 + score->score;
+}
+
+static void writer (const char *file,int w)
+{
+   score_t scores[BIG_NUMSCORES],score;
+   standing_t standing;
+   int n;
+
+   for (n = 0; n < ENTRIES; n++)
+	 {
+		entry (&score,w,n);
+		if (scorefile_add (file,&score,1,scores) != OK ||
+			leaderboard_submit (file,&score,&standing) != OK ||
+			standing.rank < 1 || standing.rank > standing.count)
+		  _exit (EXIT_FAILURE);
+	 }
+   _exit (EXIT_SUCCESS);
+}
+
+/* Read until told to stop; any file seen must be a whole one */
+static void reader (const char *file)
+{
+   score_t scores[BIG_NUMSCORES];
+   for (;;)
+	 {
+		scorefile_init (scores);
+		if (scorefile_read (file,scores) != 5) _exit (EXIT_FAILURE);
+	 }
+}
+
+/* Remove what's left of the last run, but not the directories, which may be set up to share */
+static void startover (const char *file)
+{
+   static const char *names[] = { "board", "board.new", "log", "log.old", "compact.lock", "" };
+   char path[4096];
+   int i;
+
+   unlink (file);
+   for (i = 0; *names[i] != '\0'; i++)
+	 {
+		snprintf (path,sizeof (path),"%s%s/%s",file,LEADERBOARD_SUFFIX,names[i]);
+		unlink (path);
+	 }
+}
+
+/* Is score in the file's list for the mode? */
+static bool kept (const score_t scores[BIG_NUMSCORES],const score_t *score)
+{
+   int i;
+   for (i = score->trad_mode * NUMSCORES; i < (score->trad_mode + 1) * NUMSCORES; i++)
+	 if (scores[i].score == score->score && strcmp (scores[i].name,score->name) == 0) return TRUE;
+   return FALSE;
+}
+
+int main (int argc,char *argv[])
+{
+   const char *file = argc > 1 ? argv[1] : "notint-stress.scores";
+   score_t scores[BIG_NUMSCORES],score;
+   pid_t readers[READERS],writers[WRITERS];
+   int i,s,status,lock,failed = 0,missing = 0,lost = 0,num[GAME_MODE_COUNT];
+   leaderboard_t lb;
+
+   /* start from an empty list */
+   startover (file);
+   scorefile_init (scores);
+   if (scorefile_write (file,scores) != OK)
+	 {
+		fprintf (stderr,"scorestress: cannot write %s\n",file);
+		return EXIT_FAILURE;
+	 }
+   for (i = 0; i < READERS; i++)
+	 if ((readers[i] = fork ()) == 0) reader (file);
+   for (i = 0; i < WRITERS; i++)
+	 if ((writers[i] = fork ()) == 0) writer (file,i);
+   for (i = 0; i < WRITERS; i++)
+	 if (waitpid (writers[i],&status,0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != EXIT_SUCCESS) failed++;
+   for (i = 0; i < READERS; i++)
+	 {
+		kill (readers[i],SIGTERM);
+		if (waitpid (readers[i],&status,0) < 0 || !WIFSIGNALED (status) || WTERMSIG (status) != SIGTERM) failed++;
+	 }
+
+   scorefile_init (scores);
+   if (scorefile_read (file,scores) != 5)
+	 {
+		fprintf (stderr,"scorestress: cannot read %s\n",file);
+		return EXIT_FAILURE;
+	 }
+   /* the scores are all different, best first they're these */
+   for (i = 0; i < GAME_MODE_COUNT; i++) num[i] = 0;
+   for (s = WRITERS * ENTRIES; s > 0; s--)
+	 {
+		entry (&score,(s - 1) % WRITERS,(s - 1) / WRITERS);
+		if (num[score.trad_mode]++ < NUMSCORES && !kept (scores,&score)) missing++;
+	 }
+
+   /* and every one of them is on the leaderboard, once */
+   leaderboard_init (&lb);
+   lock = scorefile_lock (file);
+   if (leaderboard_load (&lb,file) != OK) failed++;
+   scorefile_unlock (lock);
+   for (i = 0; i < GAME_MODE_COUNT; i++)
+	 lost += num[i] - (lb.root[i] != 0 ? lb.nodes[lb.root[i]].size : 0);
+   leaderboard_free (&lb);
+
+   printf ("%d writers saved %d scores each, %d readers: %d failed, %d of the best scores missing, %d scores not on the leaderboard\n",
+		   WRITERS,ENTRIES,READERS,failed,missing,lost);
+   return failed || missing || lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "engine.h"
+#include "replay.h"
+#include "session.h"
+
+/* Won't compile once a session_t outgrows SESSION_MAXSIZE */
+typedef char session_size_check[sizeof (session_t) <= SESSION_MAXSIZE ? 1 : -1];
+
+/*
+ * Functions
+ */
+
+void session_init (session_t *session,void (*score_function)(engine_t *),uint64_t seed)
+{
+   memset (session,0,sizeof (session_t));
+   engine_init (&session->engine,score_function,seed);
+   session->shapecount[session->engine.curshape]++;
+}
+
+int session_event (session_t *session,int event,int arg)
+{
+   engine_t *engine = &session->engine;
+   int result = 1;
+   switch (event)
+	 {
+	  case EVENT_LEFT:
+		engine_move (engine,ACTION_LEFT);
+		break;
+	  case EVENT_ROTATE:
+		engine_move (engine,ACTION_ROTATE);
+		break;
+	  case EVENT_RIGHT:
+		engine_move (engine,ACTION_RIGHT);
+		break;
+	  case EVENT_DROP:
+		engine_move (engine,ACTION_DROP);
+		break;
+	  case EVENT_TICK:
+		switch (result = engine_evaluate (engine))
+		  {
+			 /* game over (board full) */
+		   case -1:
+			 if ((engine->level < MAXLEVEL) && ((engine->status.droppedlines / 10) > engine->level)) engine->level++;
+			 break;
+			 /* shape at bottom, next one released */
+		   case 0:
+			 engine_levelcheck (engine);
+			 session->shapecount[engine->curshape]++;
+			 break;
+		  }
+		break;
+	  case EVENT_LEVEL:
+		if (engine->level < MAXLEVEL) engine->level++;
+		/* wrap around on zen */
+		else if (engine->game_mode == GAME_ZEN) engine->level = MINLEVEL;
+		break;
+	  case EVENT_PAUSE:
+		engine->accumulated_pause += arg;
+		break;
+	  case EVENT_OPTION:
+		if (arg == 's') engine->shownext = TRUE;
+		else if (arg == 'd') engine->dottedlines = !engine->dottedlines;
+		break;
+	 }
+   return result;
+}
+
+int session_pieces (const session_t *session)
+{
+   int i,sum = 0;
+   for (i = 0; i < NUMSHAPES; i++) sum += session->shapecount[i];
+   return sum;
+}
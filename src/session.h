@@ -0,0 +1,88 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+#include "basic.h"
+#include "engine.h"
+
+/*
+ * Macros
+ */
+
+/* The most a session_t may take, so a host can keep lots of games in memory */
+#define SESSION_MAXSIZE	512
+
+/*
+ * Type definitions
+ */
+
+/*
+ * One player's game: the engine, and what a front end keeps about the
+ * game beside it. Everything that can be shared or is only needed
+ * while somebody is looking (the shapes, the computer player's search,
+ * what is on the screen) lives elsewhere.
+ */
+typedef struct
+{
+   engine_t engine;
+   long long start_ms;			/* when play started, on the front end's clock */
+   int shapecount[NUMSHAPES];		/* shapes released so far, by type */
+   unsigned char show_special;		/* frames left showing a special level */
+   unsigned char show_cleared;		/* holding still for a cleared level */
+} session_t;
+
+/*
+ * Functions
+ */
+
+/*
+ * Start a session with a fresh engine_init () engine. The front end
+ * still picks the level and mode with engine_tweak ().
+ */
+void session_init (session_t *session,void (*score_function)(engine_t *),uint64_t seed);
+
+/*
+ * Apply one replay event (EVENT_LEFT .. EVENT_OPTION) to the game. Live
+ * games and replays both come through here, so a replay does exactly
+ * what the game did.
+ *
+ * OUTPUT:
+ *   what engine_evaluate () did for EVENT_TICK, otherwise 1
+ */
+int session_event (session_t *session,int event,int arg);
+
+/*
+ * Shapes released so far
+ */
+int session_pieces (const session_t *session);
+
+#endif	/* #ifndef SESSION_H */
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * notint-sim: play lots of headless games on every core with a
+ * built-in player, and report how fast they went and how they scored.
+ * Handy for trying out rule changes (PERCENT_RAND, STATUS_GROUP, ...)
+ * before anybody has to play them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define NEED_GAMETYPE
+
+#include "notint.h"
+
+/*
+ * Type definitions
+ */
+
+/*
+ * A player: makes its moves for a freshly released shape, or leaves a
+ * plan for them (which can wait for gravity) in plan. Players that
+ * search get room for it, one per thread.
+ */
+typedef struct
+{
+   const char *name;
+   const char *help;
+   void (*play)(engine_t *engine,rng_t *rng,ai_search_t *search,placement_t *plan);
+   bool search;
+} policy_t;
+
+/* What came out of one game */
+typedef struct
+{
+   int score;
+   int lines;
+   int pieces;
+} result_t;
+
+/* Running totals for one game mode on one thread */
+typedef struct
+{
+   long long games;
+   long long pieces;
+   long long usec;		/* time spent playing them */
+} totals_t;
+
+/*
+ * Global variables
+ */
+
+static int numgames = 10000;
+static int numthreads = 0;
+static int start_level = 0;
+static int maxpieces = 100000;
+static bool shownext = FALSE;
+static bool dottedlines = FALSE;
+static uint64_t base_seed = 1;
+static const policy_t *policy;
+static int beam = AI_BEAM;
+static int sessions = 0;		/* -M: just measure this many */
+
+/* modes to play, in letters as notint takes them */
+static char modes[GAME_MODE_COUNT + 1] = "etzcS";
+static int nummodes;
+static int modelist[GAME_MODE_COUNT];
+
+/* games are handed out in chunks from this counter */
+#define CHUNK 64
+static long long next_game;
+static long long total_games;
+
+static result_t *results;	/* [mode][game] */
+static totals_t totals[GAME_MODE_COUNT];
+static long long searches,searched,search_usec;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Policies
+ */
+
+/* Drop every shape where it appears */
+static void play_drop (engine_t *engine,rng_t *rng,ai_search_t *search,placement_t *plan)
+{
+   engine_move (engine,ACTION_DROP);
+}
+
+/* Random rotation, random column, then drop */
+static void play_random (engine_t *engine,rng_t *rng,ai_search_t *search,placement_t *plan)
+{
+   int rot = rng_below (rng,4);
+   int target = 1 + rng_below (rng,NUMCOLS - 3);
+   int x;
+   while (rot--) engine_move (engine,ACTION_ROTATE);
+   while (engine->curx != target)
+	 {
+		x = engine->curx;
+		engine_move (engine,engine->curx < target ? ACTION_RIGHT : ACTION_LEFT);
+		if (x == engine->curx) break;
+	 }
+   engine_move (engine,ACTION_DROP);
+}
+
+/* The computer player's pick */
+static void play_greedy (engine_t *engine,rng_t *rng,ai_search_t *search,placement_t *plan)
+{
+   ai_choose (engine,&AI_WEIGHTS,plan);
+}
+
+/* The computer player's pick, looking ahead to the next shape */
+static void play_beam (engine_t *engine,rng_t *rng,ai_search_t *search,placement_t *plan)
+{
+   ai_search (search,engine,2,&AI_WEIGHTS,plan);
+}
+
+static const policy_t policies[] =
+{
+   { "random", "random rotation and column", play_random, FALSE },
+   { "drop",   "drop where it appears",      play_drop, FALSE },
+   { "greedy", "best placement for the board (see ai.h)", play_greedy, FALSE },
+   { "beam",   "best placement with the next shape too (see -w)", play_beam, TRUE },
+   { NULL, NULL, NULL, FALSE }
+};
+
+/*
+ * Functions
+ */
+
+static long long usec_now ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC,&ts);
+   return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Set up a freshly initialized engine the way notint would for this mode */
+static void setgame (engine_t *engine,int mode)
+{
+   int level = start_level;
+   engine->headless = TRUE;
+   engine->dottedlines = dottedlines;
+   /* notint always shows the next shape in these */
+   engine->shownext = shownext || (mode == GAME_EASYTRIS) || (mode == GAME_ZEN);
+   if (level < MINLEVEL) level = (mode == GAME_ZEN) ? GAME_ZEN_LEVEL : MINLEVEL;
+   engine_tweak (level,mode,engine);
+}
+
+/* A new game for this mode */
+static void newgame (engine_t *engine,int mode,uint64_t seed)
+{
+   engine_init (engine,score_standard,seed);
+   setgame (engine,mode);
+}
+
+/* Play one game to the end (or maxpieces) */
+static void playgame (int mode,uint64_t seed,ai_search_t *search,result_t *result)
+{
+   engine_t engine;
+   rng_t rng;
+   placement_t plan;
+   bool fresh = TRUE;
+   int pieces = 1,step = 0;
+
+   newgame (&engine,mode,seed);
+   /* the player gets its own numbers, so it can't change the shapes */
+   rng_seed (&rng,~seed);
+   for (;;)
+	 {
+		if (fresh)
+		  {
+			 plan.length = 0;
+			 policy->play (&engine,&rng,search,&plan);
+			 step = engine_place (&engine,&plan,0);
+			 fresh = FALSE;
+		  }
+		engine.clock_usec += engine_delay (&engine);
+		switch (engine_evaluate (&engine))
+		  {
+		   case -1:
+			 goto done;
+		   case 1:
+			 if (step < plan.length) step = engine_place (&engine,&plan,step + 1);
+			 break;
+		   case 0:
+			 engine_levelcheck (&engine);
+			 if (++pieces > maxpieces) goto done;
+			 fresh = TRUE;
+			 break;
+		  }
+	 }
+done:
+   result->score = GETSCORE (engine.score);
+   result->lines = engine.status.droppedlines;
+   result->pieces = pieces;
+}
+
+static void *worker (void *arg)
+{
+   totals_t mine[GAME_MODE_COUNT];
+   ai_search_t search;
+   long long first,i,start;
+   int m,mode;
+
+   memset (mine,0,sizeof (mine));
+   if (policy->search && ai_search_init (&search,beam) != OK)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+   for (;;)
+	 {
+		first = __sync_fetch_and_add (&next_game,CHUNK);
+		if (first >= total_games) break;
+		for (i = first; i < first + CHUNK && i < total_games; i++)
+		  {
+			 /* interleave modes so long games are spread about */
+			 m = i % nummodes;
+			 mode = modelist[m];
+			 start = usec_now ();
+			 playgame (mode,base_seed + i / nummodes,&search,&results[(long long) m * numgames + i / nummodes]);
+			 mine[mode].usec += usec_now () - start;
+			 mine[mode].games++;
+			 mine[mode].pieces += results[(long long) m * numgames + i / nummodes].pieces;
+		  }
+	 }
+   pthread_mutex_lock (&totals_lock);
+   for (mode = 0; mode < GAME_MODE_COUNT; mode++)
+	 {
+		totals[mode].games += mine[mode].games;
+		totals[mode].pieces += mine[mode].pieces;
+		totals[mode].usec += mine[mode].usec;
+	 }
+   if (policy->search)
+	 {
+		searches += search.searches;
+		searched += search.searched;
+		search_usec += search.usec;
+		ai_search_free (&search);
+	 }
+   pthread_mutex_unlock (&totals_lock);
+   return NULL;
+}
+
+static int cmpint (const void *a,const void *b)
+{
+   int av = *(const int *) a,bv = *(const int *) b;
+   return (av > bv) - (av < bv);
+}
+
+/* One line of min / percentiles / max / mean */
+static void showdist (const char *what,int *v,int n)
+{
+   long long sum = 0;
+   int i;
+   for (i = 0; i < n; i++) sum += v[i];
+   qsort (v,n,sizeof (int),cmpint);
+   printf ("  %-6s %9.1f %8d %8d %8d %8d %8d %8d\n",what,(double) sum / n,
+		   v[0],v[n / 10],v[n / 2],v[n - 1 - n / 10],v[n - 1 - n / 100],v[n - 1]);
+}
+
+static void report (long long usec)
+{
+   static const char letter[GAME_MODE_COUNT] = { 'e', 't', 'z', 'c', 'S' };
+   long long games = 0,pieces = 0;
+   int *v,m,mode,i;
+   double secs = usec / 1e6;
+
+   v = malloc (numgames * sizeof (int));
+   if (v == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+   for (m = 0; m < nummodes; m++)
+	 {
+		mode = modelist[m];
+		games += totals[mode].games;
+		pieces += totals[mode].pieces;
+		printf ("%s (-%c): %lld games, %lld pieces, %.0f pieces/sec per thread\n",
+				gametype[mode],letter[mode],totals[mode].games,totals[mode].pieces,
+				totals[mode].usec ? totals[mode].pieces / (totals[mode].usec / 1e6) : 0.0);
+		printf ("  %-6s %9s %8s %8s %8s %8s %8s %8s\n","","mean","min","p10","p50","p90","p99","max");
+		for (i = 0; i < numgames; i++) v[i] = results[(long long) m * numgames + i].score;
+		showdist ("score",v,numgames);
+		for (i = 0; i < numgames; i++) v[i] = results[(long long) m * numgames + i].lines;
+		showdist ("lines",v,numgames);
+		for (i = 0; i < numgames; i++) v[i] = results[(long long) m * numgames + i].pieces;
+		showdist ("pieces",v,numgames);
+	 }
+   free (v);
+   printf ("\n%lld games, %lld pieces in %.3f sec on %d threads: %.0f games/sec, %.0f pieces/sec\n",
+		   games,pieces,secs,numthreads,games / secs,pieces / secs);
+   if (searches > 0)
+	 printf ("%lld searches, beam %d: %lld nodes, %.0f nodes/sec per thread, %.1f usec per search\n",
+			 searches,beam,searched,search_usec ? searched / (search_usec / 1e6) : 0.0,(double) search_usec / searches);
+}
+
+/*
+ * Snapshot every session and put each back (engine_restore ()) into
+ * one engine, against copying the engine_t, and make sure every
+ * snapshot gives back the game it was taken of
+ */
+static void snapshotbench (const session_t *sessions,int count)
+{
+   engine_snapshot_t *snapshots;
+   engine_t engine;
+   long long start,taken,restored,copied;
+   int i,bad = 0;
+
+   if ((snapshots = malloc ((size_t) count * sizeof (engine_snapshot_t))) == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+   start = usec_now ();
+   for (i = 0; i < count; i++) engine_snapshot (&sessions[i].engine,&snapshots[i]);
+   taken = usec_now () - start;
+   engine = sessions[0].engine;
+   start = usec_now ();
+   for (i = 0; i < count; i++)
+	 {
+		engine_restore (&engine,&snapshots[i]);
+		if (engine_hash (&engine) != engine_hash (&sessions[i].engine)) bad++;
+	 }
+   restored = usec_now () - start;
+   /* the same checks, so only the copy differs */
+   start = usec_now ();
+   for (i = 0; i < count; i++)
+	 {
+		engine = sessions[i].engine;
+		if (engine_hash (&engine) != engine_hash (&sessions[i].engine)) bad++;
+	 }
+   copied = usec_now () - start;
+   printf ("%d snapshots of %d bytes: %.0f ns to take one, %.0f ns to restore one, %.0f ns to copy an engine_t\n",
+		   count,(int) sizeof (engine_snapshot_t),taken * 1e3 / count,restored * 1e3 / count,copied * 1e3 / count);
+   free (snapshots);
+   if (bad)
+	 {
+		fprintf (stderr,"%d snapshots didn't give back their game\n",bad);
+		exit (EXIT_FAILURE);
+	 }
+}
+
+/*
+ * Start lots of sessions, round the modes, and leave them idle: what
+ * keeping that many games in one process costs in memory, and what
+ * snapshots of them cost
+ */
+static void memorybench (int count)
+{
+   struct rusage before,after;
+   session_t *sessions;
+   long kb;
+   int i;
+
+   getrusage (RUSAGE_SELF,&before);
+   if ((sessions = malloc ((size_t) count * sizeof (session_t))) == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+   for (i = 0; i < count; i++)
+	 {
+		session_init (&sessions[i],score_standard,base_seed + i);
+		setgame (&sessions[i].engine,modelist[i % nummodes]);
+	 }
+   /* peak resident size, in kilobytes; it only grew since */
+   getrusage (RUSAGE_SELF,&after);
+   kb = after.ru_maxrss - before.ru_maxrss;
+   printf ("%d idle sessions of %d bytes: %ld KB resident, %.0f bytes a session\n",
+		   count,(int) sizeof (session_t),kb,kb * 1024.0 / count);
+   snapshotbench (sessions,count);
+   free (sessions);
+}
+
+static void showhelp ()
+{
+   const policy_t *p;
+   fprintf (stderr,"USAGE: notint-sim [-g games] [-j threads] [-m modes] [-p policy] [-w width]\n");
+   fprintf (stderr,"                  [-l level] [-s seed] [-P pieces] [-n] [-d] [-M sessions]\n");
+   fprintf (stderr,"  -g <games>   Games to play in each mode (default %d)\n",numgames);
+   fprintf (stderr,"  -j <threads> Threads to use (default: one per core)\n");
+   fprintf (stderr,"  -m <modes>   Modes to play, each of c, e, t, z, S at most once (default %s)\n",modes);
+   fprintf (stderr,"  -p <policy>  How to play:\n");
+   for (p = policies; p->name != NULL; p++) fprintf (stderr,"                 %-8s %s\n",p->name,p->help);
+   fprintf (stderr,"  -w <width>   Boards the beam policy looks ahead from (default %d)\n",AI_BEAM);
+   fprintf (stderr,"  -l <level>   Starting level (default %d, zen %d)\n",MINLEVEL,GAME_ZEN_LEVEL);
+   fprintf (stderr,"  -s <seed>    First seed; game n of each mode uses seed + n (default 1)\n");
+   fprintf (stderr,"  -P <pieces>  Stop any game after this many pieces (default %d)\n",maxpieces);
+   fprintf (stderr,"  -n           Play with the show next penalty\n");
+   fprintf (stderr,"  -d           Play with the dotted lines penalty\n");
+   fprintf (stderr,"  -M <count>   Don't play: measure the memory of this many idle sessions,\n");
+   fprintf (stderr,"               and the time to snapshot and restore them\n");
+   exit (EXIT_FAILURE);
+}
+
+static void parse_options (int argc,char *argv[])
+{
+   int i = 1,seed;
+   const policy_t *p;
+   char *c;
+   policy = &policies[0];
+   while (i < argc)
+	 {
+		if (strcmp (argv[i],"-g") == 0)
+		  {
+			 if (++i >= argc || !str2int (&numgames,argv[i]) || numgames < 1) showhelp ();
+		  }
+		else if (strcmp (argv[i],"-j") == 0)
+		  {
+			 if (++i >= argc || !str2int (&numthreads,argv[i]) || numthreads < 1) showhelp ();
+		  }
+		else if (strcmp (argv[i],"-l") == 0)
+		  {
+			 if (++i >= argc || !str2int (&start_level,argv[i]) || start_level < MINLEVEL) showhelp ();
+		  }
+		else if (strcmp (argv[i],"-P") == 0)
+		  {
+			 if (++i >= argc || !str2int (&maxpieces,argv[i]) || maxpieces < 1) showhelp ();
+		  }
+		else if (strcmp (argv[i],"-s") == 0)
+		  {
+			 if (++i >= argc || !str2int (&seed,argv[i])) showhelp ();
+			 base_seed = (uint64_t) seed;
+		  }
+		else if (strcmp (argv[i],"-m") == 0)
+		  {
+			 if (++i >= argc || strlen (argv[i]) < 1 || strlen (argv[i]) > GAME_MODE_COUNT) showhelp ();
+			 strcpy (modes,argv[i]);
+		  }
+		else if (strcmp (argv[i],"-p") == 0)
+		  {
+			 if (++i >= argc) showhelp ();
+			 for (p = policies; p->name != NULL; p++) if (strcmp (p->name,argv[i]) == 0) break;
+			 if (p->name == NULL) showhelp ();
+			 policy = p;
+		  }
+		else if (strcmp (argv[i],"-w") == 0)
+		  {
+			 if (++i >= argc || !str2int (&beam,argv[i]) || beam < 1) showhelp ();
+		  }
+		else if (strcmp (argv[i],"-n") == 0)
+		  shownext = TRUE;
+		else if (strcmp (argv[i],"-d") == 0)
+		  dottedlines = TRUE;
+		else if (strcmp (argv[i],"-M") == 0)
+		  {
+			 if (++i >= argc || !str2int (&sessions,argv[i]) || sessions < 1) showhelp ();
+		  }
+		else
+		  {
+			 fprintf (stderr,"Invalid option -- %s\n",argv[i]);
+			 showhelp ();
+		  }
+		i++;
+	 }
+
+   for (c = modes; *c; c++)
+	 {
+		/* each mode is played and counted once */
+		if (strchr (c + 1,*c) != NULL) showhelp ();
+		switch (*c)
+		  {
+		   case 'e': modelist[nummodes++] = GAME_EASYTRIS; break;
+		   case 't': modelist[nummodes++] = GAME_TRADITIONAL; break;
+		   case 'z': modelist[nummodes++] = GAME_ZEN; break;
+		   case 'c': modelist[nummodes++] = GAME_CHALLENGE; break;
+		   case 'S': modelist[nummodes++] = GAME_SPEED; break;
+		   default: showhelp ();
+		  }
+	 }
+
+   if (numthreads < 1)
+	 {
+		numthreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+		if (numthreads < 1) numthreads = 1;
+	 }
+}
+
+int main (int argc,char *argv[])
+{
+   pthread_t *threads;
+   long long start;
+   int i;
+
+   parse_options (argc,argv);
+   if (sessions > 0)
+	 {
+		memorybench (sessions);
+		exit (EXIT_SUCCESS);
+	 }
+   total_games = (long long) numgames * nummodes;
+   results = malloc (total_games * sizeof (result_t));
+   threads = malloc (numthreads * sizeof (pthread_t));
+   if (results == NULL || threads == NULL)
+	 {
+		fputs ("Out of memory\n",stderr);
+		exit (EXIT_FAILURE);
+	 }
+
+   /* the searches' keys are filled in once, before anyone uses them */
+   zobrist_init ();
+   start = usec_now ();
+   for (i = 0; i < numthreads; i++)
+	 if (pthread_create (&threads[i],NULL,worker,NULL) != 0)
+	   {
+		  fputs ("Cannot start thread\n",stderr);
+		  exit (EXIT_FAILURE);
+	   }
+   for (i = 0; i < numthreads; i++) pthread_join (threads[i],NULL);
+
+   report (usec_now () - start);
+   exit (EXIT_SUCCESS);
+}
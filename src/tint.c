@@ -45,135 +45,113 @@
 #include "config.h"
 #include "version.h"
 #include "engine.h"
+#include "score.h"
+#include "replay.h"
+#include "session.h"
+#include "scorefile.h"
+#include "leaderboard.h"
+#include "history.h"
+#include "scoresock.h"
+#include "ai.h"
+#include "hint.h"
 
 
-static bool shownext;
-static bool dottedlines;
-static int shapecount[NUMSHAPES];
 static int start_level = MINLEVEL - 1;
 static int gamemode = GAME_TRADITIONAL;
 static int quiet_scores = FALSE;
-static int show_special = 0;
 static char blockchar = ' ';
 static char challchar = '+';
 static char *scorefile;
+static char *scoresocket = NULL;
+static char *historyfile = NULL;
+static char *record_file = NULL;
+static char *replay_file = NULL;
+static bool replay_fast = FALSE;
+static int replay_speed = 1;
+static bool recording = FALSE;
+static bool show_attrs = FALSE;
+static bool autoplay = FALSE;
+static placement_t autoplan;
+static int autostep;
+static int beam = AI_BEAM;
+static ai_search_t search;
+static bool searching = FALSE;
+static bool hintmode = FALSE;
+static bool hintpool = FALSE;
+static bool hinting = FALSE;
+static placement_t hint;
+static replay_writer_t recorder;
+static session_t session;
 
 /*
- * Functions
+ * What drawboard () last put in each cell of the screen and where the
+ * board was, so only the cells that changed get drawn again. Walls
+ * never change, so they are drawn once.
  */
+#define CELL_UNDRAWN	-1
+#define CELL_DOTTED	0x100		/* empty, drawn with dotted lines */
+#define CELL_HINT	0x200		/* empty, where the hint puts a block (plus its color) */
+static int drawn[NUMROWS][NUMCOLS];
+static int drawn_x = -1,drawn_y = -1;
 
-/* This function is responsible for increasing the score appropriately whenever
- * a block collides at the bottom of the screen (or the top of the heap).
- * In easy-tris mode, you also get points for rows cleared.
- * In zen mode, you only get points for rows cleared.
- * In speed run mode, you get points for lines cleared per minute, zero for first ten lines and/or minute.
- * In challenge mode there are point penalties for non-challenge rows cleared,
- * and extra non-challenge mode blocks left over.
+/*
+ * Functions
  */
-static void score_function (engine_t *engine)
-{
-   int score;
-
-   if (engine->game_mode == GAME_ZEN) {
-      /* score is saved at a multiple real value */
-      engine->score += SCOREVAL (engine->status.lastclear);
-      return;
-   }
-
-   if (engine->game_mode == GAME_SPEED) {
-      int raw_score;
-      int multiplier = 60;
-
-      time_t run_time = time(NULL) - engine->start_time;
-
-      /* backwards from regular game because of how multipler gets
-       * used here.
-       */
-      if (shownext) multiplier *= SCORE_PENALTY;
-      if (dottedlines) multiplier *= SCORE_PENALTY;
-
-      /* To discourage using pause: it 50% of pause counts towards
-       * your run time.
-       */
-      run_time -= engine->accumulated_pause / 2;
-
-      if ((run_time < 60) || (engine->status.droppedlines < 10)) {
-         raw_score = 0;
-      } else {
-         raw_score = (engine->status.droppedlines * 60) / run_time;
-         multiplier = run_time / multiplier;
-	 raw_score *= multiplier;
-      }
-
-      /* score is saved at a multiple real value */
-      engine->score = SCOREVAL (raw_score);
-      return;
-   }
-
-   if (engine->game_mode == GAME_CHALLENGE)
-       {
-            score = 0;
-
-	    /* Drop distance bonus only applies if line count is appropriate for
-	     * that level in traditional.
-	     */
-	    if ((10 * engine->level) > engine->status.droppedlines)
-	       {
-		    score += SCOREVAL (engine->level * (engine->status.dropcount + 1));
-	       }
-
-
-	    /* Penalty for clearing a line without any challenge blocks.
-	     */
-	    if (engine->status.lastclear && (engine->status.challengeblocks == engine->status.challengeblocks_prev))
-	       {
-		    score /= SCORE_PENALTY;
-	       }
-
-	    /* Cleared this challenge level! */
-            if (0 == engine->status.challengeblocks)
-	       {
-		    /* bonus for clearing all of the challenge blocks */
-		    score += SCOREVAL (engine->level * engine->status.challengestart);
-		    /* and penalty for any other blocks remaining */
-		    score -= SCOREVAL (2 * engine->status.nonchallengeblocks);
-	       }
-		    
-	    engine->status.challengeblocks_prev = engine->status.challengeblocks;
-       }
-   else
-       {
-	    /* Tradional scoring: most points come from how far a piece fell */
-            score = SCOREVAL (engine->level * (engine->status.dropcount + 1));
-       }
-
-   if (shownext) score /= SCORE_PENALTY;
-   if (dottedlines) score /= SCORE_PENALTY;
-
-   /* Easytris bonus for actually clearing some lines */
-   if(engine->game_mode == GAME_EASYTRIS)
-       {
-          score += engine->level * engine->status.lastclear;
-       }
 
-   engine->score += score;
+/* Forget what is on the screen, so the next drawboard () draws it all */
+static void forgetboard (int fromrow,int torow)
+{
+   int x,y;
+   for (y = fromrow; y < torow; y++) for (x = 0; x < NUMCOLS; x++)
+	 drawn[y][x] = CELL_UNDRAWN;
+}
 
-   /* be nice to challenge players */
-   if( engine->score < 0 ) { engine->score = 0; }
+/* The cells of the hint's shape, if one is showing */
+static void hintrows (row_t rows[NUMROWS])
+{
+   const shape_t *shape = &SHAPES[hint.state];
+   int i;
+   memset (rows,0,NUMROWS * sizeof (row_t));
+   if (!hinting) return;
+   for (i = 0; i < NUMBLOCKS; i++)
+	 rows[hint.y + shape->block[i].y] |= COLBIT (hint.x + shape->block[i].x);
 }
 
 /* Draw the board on the screen */
-static void drawboard (board_t board)
+static void drawboard (engine_t *engine)
 {
+   board_t *board = &engine->board;
+   row_t hinted[NUMROWS];
    int x,y;
-   int color, chall;
+   int cell, color, chall;
    out_setattr (ATTR_OFF);
+   hintrows (hinted);
+
+   /* the terminal was resized, so the board moved */
+   if (XTOP != drawn_x || YTOP != drawn_y)
+	 {
+		forgetboard (0,NUMROWS);
+		drawn_x = XTOP;
+		drawn_y = YTOP;
+	 }
    
    for (y = 1; y < NUMROWS - 1; y++) for (x = 0; x < NUMCOLS - 1; x++)
 	 {
+		cell = BOARD_CELL (board,x,y);
+		if (cell == 0 && (hinted[y] & COLBIT (x))) cell = CELL_HINT | SHAPES[hint.state].color;
+		else if (cell == 0 && engine->dottedlines) cell = CELL_DOTTED;
+		if (drawn[y][x] == cell) continue;
+		drawn[y][x] = cell;
 		out_gotoxy (XTOP + x * 2,YTOP + y);
-                color = (board[x][y] & COLOR_MASK);
-                chall = (board[x][y] & CHALLENGE_MASK);
+                color = (cell & COLOR_MASK);
+                chall = (cell & CHALLENGE_MASK);
+		if (cell & CELL_HINT)
+		  {
+			 out_setcolor (color,COLOR_BLACK);
+			 out_putch ('[');
+			 out_putch (']');
+			 continue;
+		  }
 		switch (color)
 		  {
 			 /* Wall */
@@ -186,7 +164,7 @@ static void drawboard (board_t board)
 			 break;
 			 /* Background */
 		   case 0:
-			 if (dottedlines)
+			 if (engine->dottedlines)
 			   {
 				  out_setcolor (COLOR_BLUE,COLOR_BLACK);
 				  out_putch ('.');
@@ -214,15 +192,24 @@ static void drawboard (board_t board)
 			   }
 		  }
 	 }
-   if(show_special) {
+   if(session.show_special) {
 	  out_setcolor (COLOR_WHITE,COLOR_BLACK);
 	  out_gotoxy (XTOP + 6, YTOP + 4);
 	  out_printf ("This  Level");
           out_setcolor (COLOR_YELLOW,COLOR_BLACK);
 	  out_gotoxy (XTOP + 5, YTOP + 7);
 	  out_printf ("Feels Special");
+	  /* the cells under the message need drawing when it goes */
+	  forgetboard (4,5);
+	  forgetboard (7,8);
 	  /* countdown to reset */
-	  show_special --;
+	  session.show_special --;
+   }
+   if (session.show_cleared) {
+	  out_setcolor (COLOR_YELLOW,COLOR_BLACK);
+	  out_gotoxy (XTOP + 5, YTOP + 10);
+	  out_printf ("Level Cleared!");
+	  forgetboard (10,11);
    }
    out_setattr (ATTR_OFF);
 }
@@ -252,6 +239,7 @@ static void drawnext (int shapenum,int x,int y)
 /* Draw the background */
 static void drawbackground ()
 {
+   forgetboard (0,NUMROWS);
    out_setattr (ATTR_OFF);
    out_setcolor (COLOR_WHITE,COLOR_BLACK);
    out_gotoxy (4,YTOP + 7);   out_printf ("H E L P");
@@ -262,16 +250,20 @@ static void drawbackground ()
    out_gotoxy (1,YTOP + 13);  out_printf ("s: Draw next");
    out_gotoxy (1,YTOP + 14);  out_printf ("d: Toggle lines");
    out_gotoxy (1,YTOP + 15);  out_printf ("a: Advance level");
-   out_gotoxy (1,YTOP + 16);  out_printf ("q: Quit");
-   out_gotoxy (2,YTOP + 17);  out_printf ("SPACE: Drop");
+   out_gotoxy (1,YTOP + 16);  out_printf ("h: Hint");
+   out_gotoxy (1,YTOP + 17);  out_printf ("q: Quit");
+   out_gotoxy (2,YTOP + 18);  out_printf ("SPACE: Drop");
    out_gotoxy (3,YTOP + 19);  out_printf ("Next:");
 }
 
-static int getsum ()
+/* Show how many attribute changes the last frame took */
+static void showattrs ()
 {
-   int i,sum = 0;
-   for (i = 0; i < NUMSHAPES; i++) sum += shapecount[i];
-   return (sum);
+   unsigned long changes = out_attrchanges ();
+   if (!show_attrs) return;
+   out_setcolor (COLOR_WHITE,COLOR_BLACK);
+   out_gotoxy (0,out_height () - 1);
+   out_printf ("Attribute changes: %-5lu",changes);
 }
 
 /* This show the current status of the game */
@@ -279,7 +271,7 @@ static void showstatus (engine_t *engine)
 {
    static const int shapenum[NUMSHAPES] = { 4, 6, 5, 1, 0, 3, 2 };
    char tmp[MAXDIGITS + 1];
-   int i,sum = getsum ();
+   int i,sum = session_pieces (&session);
    out_setattr (ATTR_OFF);
    out_setcolor (COLOR_WHITE,COLOR_BLACK);
    if (engine->game_mode == GAME_ZEN) {
@@ -301,7 +293,7 @@ static void showstatus (engine_t *engine)
    out_setattr (ATTR_BOLD);
    out_setcolor (COLOR_YELLOW,COLOR_BLACK);
    out_printf ("  %d",GETSCORE (engine->score));
-   if (shownext) drawnext (engine->nextshape,3,YTOP + 22);
+   if (engine->shownext) drawnext (engine->nextshape,3,YTOP + 22);
    out_setattr (ATTR_OFF);
    out_setcolor (COLOR_WHITE,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 12,YTOP + 1);
@@ -314,7 +306,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_MAGENTA,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 3);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[0]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[0]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 3);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_BLACK,COLOR_RED);
@@ -323,7 +315,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_RED,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 5);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[1]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[1]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 5);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_BLACK,COLOR_WHITE);
@@ -334,7 +326,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_WHITE,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 7);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[2]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[2]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 7);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_BLACK,COLOR_GREEN);
@@ -345,7 +337,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_GREEN,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 9);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[3]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[3]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 9);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_BLACK,COLOR_CYAN);
@@ -356,7 +348,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_CYAN,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 11);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[4]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[4]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 11);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_BLACK,COLOR_BLUE);
@@ -367,7 +359,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_BLUE,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 13);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[5]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[5]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 13);
    out_printf ("%s",tmp);
    out_setattr (ATTR_OFF);
@@ -379,7 +371,7 @@ static void showstatus (engine_t *engine)
    out_setcolor (COLOR_YELLOW,COLOR_BLACK);
    out_gotoxy (out_width () - MAXDIGITS - 3,YTOP + 15);
    out_putch ('-');
-   snprintf (tmp,MAXDIGITS + 1,"%d",shapecount[shapenum[6]]);
+   snprintf (tmp,MAXDIGITS + 1,"%d",session.shapecount[shapenum[6]]);
    out_gotoxy (out_width () - strlen (tmp) - 1,YTOP + 15);
    out_printf ("%s",tmp);
    out_setcolor (COLOR_WHITE,COLOR_BLACK);
@@ -422,7 +414,7 @@ static void showstatus (engine_t *engine)
 	     out_gotoxy (out_width () - MAXDIGITS - 17,YTOP + 21);
 	     out_printf ("Other blocks : %3d", engine->status.nonchallengeblocks);
              if(engine->show_special) {
-	       show_special = SHOW_SPECIAL_ROUNDS;
+	       session.show_special = SHOW_SPECIAL_ROUNDS;
 	       engine->show_special = 0;
 	     }
 	     break;
@@ -484,55 +476,73 @@ static void print_scores(time_t curr, int mode, score_t *scores)
 
 static void getscorefile (void)
 {
-    char *envvar, *envname;
-    char *c;
-    int size, tmp;
-
-
-    if (*conf_scorefile != '$')
-	{
-	    scorefile = conf_scorefile;
-	    return;
-	}
-    c = conf_scorefile + 1;
-    while ( *c  && (*c == '_' || isalnum(tmp = *c)) ) c++;
-    /* Now c is either \0 or the first post-envname character, so
-     * either way size will be one longer than name.
-     */
-    size = c - conf_scorefile;
-    envname = (char*)malloc(size);
-    if (envname == NULL)
-        {
-	    fputs("Out of memory\n", stderr);
-	    exit(1);
-        }
-    strncpy (envname, conf_scorefile + 1, size);
-    envname[size -1] = '\0';
-    envvar = getenv(envname);
-    if (envvar == NULL)
-        {
-	    scorefile = c;
-	    return;
-	}
-    size = strlen(envvar) + strlen(c) + 1;
-    scorefile = (char*)malloc(size);
-    if (scorefile == NULL)
+    scorefile = expand_path (conf_scorefile);
+    historyfile = expand_path (conf_historyfile);
+    if (scorefile != NULL)
+        scoresocket = (char*)malloc(strlen(scorefile) + strlen(SCORESOCK_SUFFIX) + 1);
+    if (scorefile == NULL || scoresocket == NULL || historyfile == NULL)
         {
 	    fputs("Out of memory\n", stderr);
 	    exit(1);
         }
-    strcpy (scorefile, envvar);
-    strcat (scorefile, c);
-    scorefile[size -1] = '\0';
+    strcpy (scoresocket, scorefile);
+    strcat (scoresocket, SCORESOCK_SUFFIX);
+}
+
+/*
+ * Print n with a comma every three digits
+ */
+static char *commas (char *buf,long n)
+{
+   char digits[32];
+   int i,len = sprintf (digits,"%ld",n),j = 0;
+
+   for (i = 0; i < len; i++)
+	 {
+		buf[j++] = digits[i];
+		if (isdigit (digits[i]) && (len - i - 1) % 3 == 0 && i < len - 1) buf[j++] = ',';
+	 }
+   buf[j] = '\0';
+   return buf;
+}
+
+/*
+ * Where a score stands among all the scores of its mode
+ */
+static void print_standing (const standing_t *standing)
+{
+   char rank[32],count[32],best[32];
+   long top;
+
+   if (quiet_scores || standing->count < 1)
+	return;
+
+   /* round up, nobody wants to be in the top 0% */
+   top = (standing->rank * 100 + standing->count - 1) / standing->count;
+   fprintf (stderr,"You ranked #%s of %s (top %ld%%). Your best is %s.\n\n",
+			commas (rank,standing->rank),commas (count,standing->count),top,
+			commas (best,standing->best));
+}
+
+/*
+ * The name to use when the player doesn't give one, cut to fit. It's
+ * copied: the environment, passwd entry or literal it comes from isn't
+ * ours to cut.
+ */
+static void defaultname (char name[NAMELEN])
+{
+   struct passwd *pw = getpwuid (geteuid ());
+   strncpy (name,getenv_with_default (NOTINT_NAME,
+			pw != NULL ? pw->pw_name : "(mystery player)"),NAMELEN);
+   name[NAMELEN - 1] = '\0';
 }
 
 static void getname (char *name)
 {
    int okay = FALSE;
-   struct passwd *pw = getpwuid (geteuid ());
-   char *sugname = getenv_with_default (NOTINT_NAME, 
-   				pw != NULL ? pw->pw_name : "(mystery player)");
-   sugname[NAMELEN - 1] = '\0';
+   char sugname[NAMELEN];
+
+   defaultname (sugname);
 
    if (!quiet_scores)
          {
@@ -560,12 +570,6 @@ static void getname (char *name)
    fprintf (stderr,"\n");
 }
 
-static void err1 ()
-{
-   fprintf (stderr,"Error creating %s\n",scorefile);
-   exit (EXIT_FAILURE);
-}
-
 static void err2 ()
 {
    fprintf (stderr,"Error writing to %s\n",scorefile);
@@ -589,256 +593,181 @@ void showplayerstats (engine_t *engine)
 			"Efficiency  %11d\n\t"
 			"Score ratio %11d\n"
 			"\n\n",
-			engine->status.efficiency,GETSCORE (engine->score) / getsum ());
+			engine->status.efficiency,GETSCORE (engine->score) / session_pieces (&session));
 }
 
 /*
- * Blank high score data structure.
+ * Try to save a score, or show them all for score < 0
  */
-static void initscores (score_t *scores)
+static void savescores (int score)
 {
-   int i, mode;
-   mode = MODE_LOW - 1;
+   score_t scores[BIG_NUMSCORES],entry;
+   standing_t standing;
+   int result = OK,mode;
+   bool high;
+   /* last score for gamemode */
+   int offset = (gamemode + 1) * NUMSCORES - 1;
+   /* notintd has them all in memory, if it's running */
+   bool daemon = scoresock_query (scoresocket,scores) == OK;
+
+   if (!daemon)
+	 {
+		/* older files don't have every mode's scores */
+		scorefile_init (scores);
+		result = scorefile_read (scorefile,scores);
+	 }
 
-   for (i = 0; i < BIG_NUMSCORES; i++)
+   /* don't even consider writing the score file for -s mode */
+   if (score < 0)
 	 {
-		if(0 == (i % NUMSCORES)) {
-			mode ++;
+		switch (result)
+		  {
+		   case SCOREFILE_MISSING:
+			 printf("NO SCOREFILE TO PRINT\n");
+			 return;
+		   case SCOREFILE_BAD:
+			 printf("CANNOT READ SCOREFILE\n");
+			 return;
+		   case SCOREFILE_UNKNOWN:
+			 printf("INCOMPATIBLE SCOREFILE\n");
+			 return;
+		   case 2:
+		   case 3:
+			 printf("OLDER SCOREFILE; MISSING SOME SCORES\n");
+			 break;
+		  }
+		/* print each of the game mode score lists */
+		fprintf(stderr,"%s",scoretitle);
+		for (mode = 0; mode < GAME_UNKNOWN; mode ++) {
+			 print_scores (0,mode,scores);
 		}
-		strcpy (scores[i].name,"None");
-		scores[i].score = -1;
-   		scores[i].trad_mode = mode;
-		scores[i].timestamp = 0;
+		return;
+	 }
+
+   if (result == SCOREFILE_UNKNOWN || score < 1) return;
+
+   /* A file we couldn't read gets started over, so anything makes it */
+   high = result < 0 || score > scores[offset].score;
+   if (high)
+	 {
+		/* ask the name before locking anything, the player may be slow */
+		getname (entry.name);
+	 }
+   else
+	 {
+		if (!quiet_scores)
+		  fprintf (stderr, "Sorry, not a high score worthy effort.\n\n");
+		/* it still goes on the leaderboard */
+		defaultname (entry.name);
+	 }
+   entry.score = score;
+   entry.trad_mode = gamemode;
+   entry.timestamp = time (NULL);
+   /* scores may have changed since we read them, so this merges */
+   if (!daemon || scoresock_submit (scoresocket,&entry,scores,&standing) != OK)
+	 {
+		if (high && scorefile_add (scorefile,&entry,1,scores) != OK) err2 ();
+		/* being ranked is nice to have, not worth failing over */
+		if (leaderboard_submit (scorefile,&entry,&standing) != OK) standing.count = 0;
 	 }
+
+   /* just print this mode's score list */
+   print_scores (high ? entry.timestamp : 0,gamemode,scores);
+   print_standing (&standing);
 }
 
 /*
- * Create a new score file, if score at least 1
+ * Add the game that just ended to the player's history
  */
-static void createscores (int score)
+static void savehistory (engine_t *engine,long long ms)
 {
-   FILE *handle;
-   int i,j, offset;
-   score_t scores[BIG_NUMSCORES];
-   char header[MAX_HEADER];
-   if (score < 1) return;	/* No need saving this */
-
-   /* first score for gamemode */
-   offset = gamemode * NUMSCORES;
-
-   initscores (scores);
-   getname (scores[offset].name);
-   scores[offset].score = score;
-   scores[offset].trad_mode = gamemode;
-   scores[offset].timestamp = time (NULL);
-
-   if ((handle = fopen (scorefile,"w")) == NULL) err1 ();
-   strcpy (header,SCORE_MAGIC_NUMBER);
-   i = fwrite (header,strlen (SCORE_MAGIC_NUMBER),1,handle);
-   if (i != 1) err2 ();
-   for (i = 0; i < BIG_NUMSCORES; i++)
-	 {
-		j = fwrite (scores[i].name,strlen (scores[i].name) + 1,1,handle);
-		if (j != 1) err2 ();
-		j = fwrite (&(scores[i].score),sizeof (int),1,handle);
-		if (j != 1) err2 ();
-		j = fwrite (&(scores[i].trad_mode),sizeof (int),1,handle);
-		if (j != 1) err2 ();
-		j = fwrite (&(scores[i].timestamp),sizeof (time_t),1,handle);
-		if (j != 1) err2 ();
-	 }
-   fclose (handle);
-
-   /* Just print the current mode's scores */
-   print_scores(scores[0].timestamp, gamemode, scores);
+   game_t game;
+
+   game.timestamp = time (NULL);
+   game.mode = engine->game_mode;
+   game.start_level = start_level;
+   game.level = engine->level;
+   game.score = GETSCORE (engine->score);
+   game.lines = engine->status.droppedlines;
+   game.duration = ms - engine->accumulated_pause * 1000;
+   game.efficiency = engine->status.efficiency;
+   memcpy (game.shapecount,session.shapecount,sizeof (game.shapecount));
+   if (history_append (historyfile,&game,1) != OK)
+	 fprintf (stderr,"Error writing to %s\n",historyfile);
 }
 
-static int cmpscores (const void *a,const void *b)
+/* Milliseconds as m:ss */
+static char *minutes (char *buf,long long ms)
 {
-   int result, av, bv;
-   time_t result_time, at, bt;
-
-   av = (int) ((score_t *) a)->trad_mode;
-   bv = (int) ((score_t *) b)->trad_mode;
-   result = av - bv;
-
-   /* (REVERSE) Sort by gamemmode first */
-   /* a < b */
-   if (result < 0) return -1;
-   /* a > b */
-   if (result > 0) return 1;
-   /* a = b */
-
-   /* Then by score */
-   av = (int) ((score_t *) a)->score;
-   bv = (int) ((score_t *) b)->score;
-   result = av - bv;
-
-   /* a < b */
-   if (result < 0) return 1;
-   /* a > b */
-   if (result > 0) return -1;
-   /* a = b */
-
-   /* Then by timestamp (REVERSE again) */
-   at = (int) ((score_t *) a)->timestamp;
-   bt = (int) ((score_t *) b)->timestamp;
-   result_time = at - bt;
-
-   /* a is older */
-   if (result_time < 0) return -1;
-   /* b is older */
-   if (result_time > 0) return 1;
-   /* timestamps is equal */
-   return 0;
+   sprintf (buf,"%lld:%02lld",ms / 60000,ms / 1000 % 60);
+   return buf;
 }
 
 /*
- * Try to save a score. Calls createscores() on read error of scorefile.
- * createscores() is no-op for score <= 0
+ * Show what the player's history adds up to, then exit
  */
-static void savescores (int score)
+static void showstats ()
 {
-   FILE *handle;
-   int i,j,ch;
-   score_t scores[BIG_NUMSCORES];
-   int expect_scores;
-   char header[MAX_HEADER];
-   time_t tmp = 0;
-
-   if ((handle = fopen (scorefile,"r")) == NULL)
-	 {
-		createscores (score);
-		if(score < 0)
-			printf("NO SCOREFILE TO PRINT\n");
-		return;
-	 }
+   char num[3][32],time_str_buf[TIME_STR_BUF];
+   history_stats_t stats;
+   history_totals_t *t;
+   history_month_t *m;
+   int mode,i;
 
-   /* SCORE_MAGIC_NUMBER and SCORE_MAGIC_NUMBER_1 have same length by design */
-   i = fread (header,strlen (SCORE_MAGIC_NUMBER),1,handle);
-   if (i != 1)
+   if (history_stats (historyfile,&stats) != OK)
 	 {
-		createscores (score);
-		if(score < 0)
-			printf("CANNOT READ SCOREFILE\n");
-		return;
+		printf ("CANNOT READ %s\n",historyfile);
+		exit (EXIT_FAILURE);
 	 }
-   if (strncmp (SCORE_MAGIC_NUMBER_1,header,strlen (SCORE_MAGIC_NUMBER_1)) == 0)
+   if (stats.games == 0)
 	 {
-		/* this version has trad, easy, and zen
-		 * but no challenge or speed
-		 */
-	 	expect_scores = BIG_NUMSCORES - NUMSCORES - NUMSCORES;
-		if(score < 0)
-			printf("OLDER SCOREFILE; MISSING SOME SCORES\n");
+		printf ("NO GAMES PLAYED YET\n");
+		exit (EXIT_SUCCESS);
 	 }
-   else if (strncmp (SCORE_MAGIC_NUMBER_2,header,strlen (SCORE_MAGIC_NUMBER_2)) == 0)
-	 {
-		/* this version has trad, easy, zen, and challenge
-		 * but no speed
-		 */
-	 	expect_scores = BIG_NUMSCORES - NUMSCORES;
-		if(score < 0)
-			printf("OLDER SCOREFILE; MISSING SOME SCORES\n");
-	 }
-   else if (strncmp (SCORE_MAGIC_NUMBER,header,strlen (SCORE_MAGIC_NUMBER)) == 0)
-	 {
-	 	expect_scores = BIG_NUMSCORES;
-	 }
-   else 
+
+   fprintf (stderr,"%s",statstitle);
+   fprintf (stderr,"%s",statscols);
+   fprintf (stderr,"%s",statsbetw);
+   for (mode = 0; mode < GAME_MODE_COUNT; mode++)
 	 {
-		if(score < 0)
-			printf("INCOMPATIBLE SCOREFILE\n");
-		return;
+		t = &stats.mode[mode];
+		if (t->games == 0) continue;
+		fprintf (stderr,"%s|%10s |%10lld |%10lld |%9s |%11d |%11d |%10d\n",
+				 gametype[mode],commas (num[0],t->games),t->score / t->games,t->lines / t->games,
+				 minutes (num[1],t->duration / t->games),t->best.score,t->most_lines,t->top_level);
 	 }
+   fprintf (stderr,"%s",statsbetw);
 
-   if (BIG_NUMSCORES != expect_scores)
-		initscores (scores);
-
-   for (i = 0; i < expect_scores; i++)
+   /* how the average score went, month by month */
+   fprintf (stderr,"\n%s",trendcols);
+   fprintf (stderr,"%s",trendbetw);
+   for (i = 0; i < stats.months; i++)
 	 {
-		j = 0;
-		while ((ch = fgetc (handle)) != '\0')
+		m = &stats.month[i];
+		fprintf (stderr," %04d-%02d ",m->year,m->month);
+		for (mode = 0; mode < GAME_MODE_COUNT; mode++)
 		  {
-			 if ((ch == EOF) || (j >= NAMELEN - 2))
-			   {
-				  createscores (score);
-				  return;
-			   }
-			 scores[i].name[j++] = (char) ch;
-		  }
-		scores[i].name[j] = '\0';
-		j = fread (&(scores[i].score),sizeof (int),1,handle);
-		if (j != 1)
-		  {
-			 createscores (score);
-			 return;
-		  }
-		j = fread (&(scores[i].trad_mode),sizeof (int),1,handle);
-		if (j != 1)
-		  {
-			 createscores (score);
-			 return;
-		  }
-		j = fread (&(scores[i].timestamp),sizeof (time_t),1,handle);
-		if (j != 1)
-		  {
-			 createscores (score);
-			 return;
+			 if (m->games[mode]) sprintf (num[0],"%lld",m->score[mode] / m->games[mode]);
+			 else strcpy (num[0],"-");
+			 /* the traditional column is the wide one */
+			 fprintf (stderr,mode == GAME_TRADITIONAL ? "|%12s " : "|%10s ",num[0]);
 		  }
+		fprintf (stderr,"\n");
 	 }
-   fclose (handle);
-
-   /* don't even consider writing the score file for -s mode */
-   if (score < 0)
-     {
-	   int mode;
-	   /* print each of the game mode score lists */
-	   fprintf(stderr,"%s",scoretitle);
-	   for (mode = 0; mode < GAME_UNKNOWN; mode ++) {
-		print_scores (tmp,mode,scores);
-           }
-     }
-   else
-     {
-	   /* last score for gamemode */
-	   int offset = (gamemode + 1) * NUMSCORES -1;
-	   if (score > scores[offset].score)
-		 {
-			getname (scores[offset].name);
-			scores[offset].score = score;
-			scores[offset].trad_mode = gamemode;
-			scores[offset].timestamp = tmp = time (NULL);
-		 }
-            else if (!quiet_scores)
-		 {
-			fprintf (stderr, "Sorry, not a high score worthy effort.\n\n");
-		 }
-
-             
-
-	   qsort (scores,BIG_NUMSCORES,sizeof (score_t),cmpscores);
-	   if ((handle = fopen (scorefile,"w")) == NULL) err2 ();
-	   strcpy (header,SCORE_MAGIC_NUMBER);
-	   i = fwrite (header,strlen (SCORE_MAGIC_NUMBER),1,handle);
-	   if (i != 1) err2 ();
-	   for (i = 0; i < BIG_NUMSCORES; i++)
-		 {
-			j = fwrite (scores[i].name,strlen (scores[i].name) + 1,1,handle);
-			if (j != 1) err2 ();
-			j = fwrite (&(scores[i].score),sizeof (int),1,handle);
-			if (j != 1) err2 ();
-			j = fwrite (&(scores[i].trad_mode),sizeof (int),1,handle);
-			if (j != 1) err2 ();
-			j = fwrite (&(scores[i].timestamp),sizeof (time_t),1,handle);
-			if (j != 1) err2 ();
-		 }
-	   fclose (handle);
-
-	   /* just print this mode's score list */
-           print_scores(tmp,gamemode,scores);
-     }
+   fprintf (stderr,"%s",trendbetw);
 
+   /* and the games to beat */
+   fprintf (stderr,"\nPersonal bests, of %s games:\n",commas (num[2],stats.games));
+   for (mode = 0; mode < GAME_MODE_COUNT; mode++)
+	 {
+		t = &stats.mode[mode];
+		if (t->games == 0) continue;
+		strftime (time_str_buf,TIME_STR_BUF,"%Y-%m-%d",localtime (&t->best.timestamp));
+		fprintf (stderr,"%s %s points, level %d to %d, %s lines in %s, %s\n",
+				 gametype[mode],commas (num[0],t->best.score),t->best.start_level,t->best.level,
+				 commas (num[1],t->best.lines),minutes (num[2],t->best.duration),time_str_buf);
+	 }
+   exit (EXIT_SUCCESS);
 }
 
           /***************************************************************************/
@@ -847,13 +776,15 @@ static void savescores (int score)
 
 static void showhelp ()
 {
-   fprintf (stderr,"USAGE: notint [-h|-s|-v]\n");
-   fprintf (stderr,"or   : notint [-c|-e|-t|-z|-S] [-l level] [-n] [-d] [-b char]\n");
+   fprintf (stderr,"USAGE: notint [-h|-s|-v|--stats]\n");
+   fprintf (stderr,"or   : notint [-c|-e|-t|-z|-S] [-l level] [-n] [-d] [-b char] [-r file] [-A] [--beam n]\n");
+   fprintf (stderr,"or   : notint --replay file [--speed n|--fast] [-b char]\n");
 
    fprintf (stderr,"Non-game play flags (show and exit)\n");
    fprintf (stderr,"  -h           Show this help message\n");
    fprintf (stderr,"  -s           Show high scores\n");
    fprintf (stderr,"  -v           Show game version\n");
+   fprintf (stderr,"  --stats      Show averages, trends and bests from all your games\n");
 
    fprintf (stderr,"Game mode\n");
    fprintf (stderr,"  -c           Play the challenge version\n");
@@ -865,13 +796,22 @@ static void showhelp ()
    fprintf (stderr,"Game options\n");
    fprintf (stderr,"  -b <char>    Use this character to draw blocks instead of spaces\n");
    fprintf (stderr,"  -d           Draw vertical dotted lines\n");
+   fprintf (stderr,"  -D           Show how many attribute changes each frame takes\n");
    fprintf (stderr,"  -l <level>   Specify the starting level (%d-%d)\n",MINLEVEL,MAXLEVEL);
    fprintf (stderr,"  -n           Draw next shape\n");
+   fprintf (stderr,"  -r <file>    Record the game to a replay file\n");
+   fprintf (stderr,"  -A           Let the computer play (scores aren't kept)\n");
+   fprintf (stderr,"  --beam <n>   Boards the computer looks ahead from, for -A and hints (default %d)\n",AI_BEAM);
+
+   fprintf (stderr,"Replays\n");
+   fprintf (stderr,"  --replay <file> Play back a game recorded with -r\n");
+   fprintf (stderr,"  --speed <n>  Play back n times faster than it was played\n");
+   fprintf (stderr,"  --fast       Play back without drawing, just show the result\n");
 
    exit (EXIT_FAILURE);
 }
 
-static void parse_options (int argc,char *argv[])
+static void parse_options (int argc,char *argv[],engine_t *engine)
 {
    int i = 1;
    while (i < argc)
@@ -889,6 +829,8 @@ static void parse_options (int argc,char *argv[])
 		  savescores (-1);
 		  exit(EXIT_SUCCESS);
 		 }
+		else if (strcmp (argv[i],"--stats") == 0)
+		  showstats ();
 		/* Challenge? */
 		else if (strcmp (argv[i],"-c") == 0)
 		 {
@@ -928,9 +870,41 @@ static void parse_options (int argc,char *argv[])
 		  }
 		/* Show next? */
 		else if (strcmp (argv[i],"-n") == 0)
-		  shownext = TRUE;
+		  engine->shownext = TRUE;
 		else if(strcmp(argv[i],"-d")==0)
-		  dottedlines = TRUE;
+		  engine->dottedlines = TRUE;
+		/* Count attribute changes? */
+		else if (strcmp (argv[i],"-D") == 0)
+		  show_attrs = TRUE;
+		/* Autoplay? */
+		else if (strcmp (argv[i],"-A") == 0)
+		  autoplay = TRUE;
+		else if (strcmp (argv[i],"--beam") == 0)
+		  {
+			 i++;
+			 if (i >= argc || !str2int (&beam,argv[i]) || beam < 1) showhelp ();
+		  }
+		/* Record? */
+		else if (strcmp (argv[i],"-r") == 0)
+		  {
+			 i++;
+			 if (i >= argc) showhelp ();
+			 record_file = argv[i];
+		  }
+		/* Replay? */
+		else if (strcmp (argv[i],"--replay") == 0)
+		  {
+			 i++;
+			 if (i >= argc) showhelp ();
+			 replay_file = argv[i];
+		  }
+		else if (strcmp (argv[i],"--speed") == 0)
+		  {
+			 i++;
+			 if (i >= argc || !str2int (&replay_speed,argv[i]) || replay_speed < 1) showhelp ();
+		  }
+		else if (strcmp (argv[i],"--fast") == 0)
+		  replay_fast = TRUE;
 		else if(strcmp(argv[i], "-b")==0)
 		  {
 		    i++;
@@ -949,13 +923,14 @@ static void parse_options (int argc,char *argv[])
 
    if ((gamemode == GAME_EASYTRIS) || (gamemode == GAME_ZEN))
       {
-	  shownext = TRUE;
+	  engine->shownext = TRUE;
       }
 }
 
 static void choose_level ()
 {
    char buf[NAMELEN];
+   rng_t rng;
 
    if (gamemode == GAME_ZEN) {
       start_level = GAME_ZEN_LEVEL;
@@ -967,7 +942,8 @@ static void choose_level ()
    buf[strlen (buf) - 1] = '\0';
    /* sssh, not telling anyone, but no cap on level in challenge mode */
    if (!str2int (&start_level,buf) || start_level < MINLEVEL || ((gamemode != GAME_CHALLENGE) && start_level > MAXLEVEL)) {
-      start_level = 1 + rand_value(-1, 8);
+      rng_seed (&rng, rand_seed ());
+      start_level = 1 + rand_value(&rng, -1, 8);
       fprintf (stderr,"Okay, picked level %d\n",start_level);
       sleep(1);
    }
@@ -977,86 +953,238 @@ static void choose_level ()
           /***************************************************************************/
           /***************************************************************************/
 
+/* Milliseconds on a clock that never goes backwards */
+static long long now_ms ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC,&ts);
+   return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Play an event now: set the game clock, record it, apply it */
+static int live_event (int event,int arg)
+{
+   long long ms = now_ms () - session.start_ms;
+   session.engine.clock_usec = ms * 1000;
+   if (recording) replay_event (&recorder,ms,event,arg);
+   return session_event (&session,event,arg);
+}
+
+/*
+ * Where the computer would put the falling shape. It only looks ahead
+ * to the next shape when that's showing, like a player would.
+ */
+static bool bestplace (engine_t *engine,placement_t *placement)
+{
+   if (!searching)
+	 {
+		if (ai_search_init (&search,beam) != OK) return FALSE;
+		searching = TRUE;
+	 }
+   return ai_search (&search,engine,engine->shownext ? 2 : 1,&AI_WEIGHTS,placement) > 0;
+}
+
+/*
+ * Ask the hint workers where the shape that just came in should go.
+ * Whatever they have when the alarm goes is shown.
+ */
+static void askhint (engine_t *engine)
+{
+   int delay = HINT_DEADLINE (engine_delay (engine));
+   hinting = FALSE;
+   hint_request (engine,delay);
+   in_alarm (delay);
+}
+
+/* The alarm went: put up the hint, if there is one yet */
+static void showhint ()
+{
+   int complete;
+   if (!hintmode) return;
+   if (hint_result (&hint,&complete))
+	 {
+		hinting = TRUE;
+		hint_shown (complete);
+		hint_cancel ();
+	 }
+   /* not even the first round done, look again soon */
+   else in_alarm (1000);
+}
+
+/*
+ * Let the computer press keys before the next tick: it picks a place
+ * for a freshly released shape, then follows the path there up to the
+ * next time it has to wait for the shape to fall
+ */
+static void autoplay_keys (engine_t *engine,bool fresh)
+{
+   if (fresh)
+	 {
+		autoplan.length = 0;
+		bestplace (engine,&autoplan);
+		autostep = 0;
+	 }
+   for (; autostep < autoplan.length && autoplan.path[autostep] != PLACEMENT_WAIT; autostep++)
+	 live_event (autoplan.path[autostep],0);
+   /* the tick that's coming is the wait */
+   autostep++;
+}
+
+/* Play back a game recorded with -r, then exit */
+static void replay_game ()
+{
+   replay_reader_t reader;
+   replay_header_t header;
+   engine_t *engine = &session.engine;
+   struct timespec ts;
+   long long ms,last = 0,wait;
+   int event,arg,result = 1;
+
+   if (replay_open (&reader,replay_file,&header) != OK)
+	 {
+		fprintf (stderr,"Cannot read replay %s\n",replay_file);
+		exit (EXIT_FAILURE);
+	 }
+   session_init (&session,score_standard,header.seed);
+   engine->headless = replay_fast;
+   engine->shownext = (header.flags & REPLAY_SHOWNEXT) != 0;
+   engine->dottedlines = (header.flags & REPLAY_DOTTEDLINES) != 0;
+   engine_tweak (header.level,header.mode,engine);
+   if (!replay_fast)
+	 {
+		io_init ();
+		drawbackground ();
+	 }
+   while (result >= 0 && replay_next (&reader,&ms,&event,&arg))
+	 {
+		if (!replay_fast)
+		  {
+			 showstatus (engine);
+			 drawboard (engine);
+			 showattrs ();
+			 out_refresh ();
+			 /* nobody wants to sit through the pauses */
+			 wait = (ms - last) / replay_speed;
+			 if (wait > 1000) wait = 1000;
+			 ts.tv_sec = 0;
+			 ts.tv_nsec = wait * 1000000;
+			 nanosleep (&ts,NULL);
+		  }
+		last = ms;
+		engine->clock_usec = ms * 1000;
+		result = session_event (&session,event,arg);
+	 }
+   replay_free (&reader);
+   if (!replay_fast)
+	 {
+		showstatus (engine);
+		drawboard (engine);
+		out_refresh ();
+		io_close ();
+	 }
+   showplayerstats (engine);
+   fprintf (stderr,"%s  level %d, %d lines, %lld.%03lld seconds\n",
+			gametype[header.mode],
+			engine->level,engine->status.droppedlines,last / 1000,last % 1000);
+   exit (EXIT_SUCCESS);
+}
+
 int main (int argc,char *argv[])
 {
-   bool finished;
-   int ch;
-   engine_t engine;
+   bool finished,fresh = TRUE;
+   int ch,level,gravity;
+   engine_t *engine = &session.engine;
    /* Initialize */
-   rand_init ();				/* must be called before engine_init () */
    getscorefile ();
-   engine_init (&engine,score_function);	/* must be called before using engine.curshape */
-   finished = shownext = FALSE;
-   memset (shapecount,0,NUMSHAPES * sizeof (int));
-   shapecount[engine.curshape]++;
-   parse_options (argc,argv);			/* must be called after initializing variables */
+   session_init (&session,score_standard,rand_seed ());	/* must be called before using engine->curshape */
+   finished = FALSE;
+   parse_options (argc,argv,engine);			/* must be called after initializing variables */
+   if (replay_file != NULL) replay_game ();
    if (start_level < MINLEVEL) choose_level ();
-   engine_tweak (start_level, gamemode, &engine);	/* must be called after level selected */
+   engine_tweak (start_level, gamemode, engine);	/* must be called after level selected */
+   if (record_file != NULL)
+	 {
+		replay_header_t header;
+		header.seed = engine->seed;
+		header.mode = gamemode;
+		header.level = start_level;
+		header.flags = (engine->shownext ? REPLAY_SHOWNEXT : 0) | (engine->dottedlines ? REPLAY_DOTTEDLINES : 0);
+		if (replay_create (&recorder,record_file,&header) != OK)
+		  {
+			 fprintf (stderr,"Cannot record to %s\n",record_file);
+			 exit (EXIT_FAILURE);
+		  }
+		recording = TRUE;
+	 }
    io_init ();
    drawbackground ();
-   if (engine.game_mode == GAME_CHALLENGE) {
+   if (engine->game_mode == GAME_CHALLENGE) {
      /* use up or A to increase speed, normal challenge mode doesn't
       * scale speed to level.
       */
-     in_timeout (CHALLENGE_DELAY);
-     /* but for scoring purposes, don't give them extra levels worth
-      * of "free" lines to clear.
-      */
-     engine.status.droppedlines = 10 * (engine.level - 1);
+     gravity = CHALLENGE_DELAY;
    } else {
      /* starting drop speed linked to game level */
-     in_timeout (DELAY);
+     gravity = DELAY;
    }
+   in_timeout (gravity);
+   session.start_ms = now_ms ();
    /* Main loop */
    do
 	 {
 		/* draw shape */
-		showstatus (&engine);
-		drawboard (engine.board);
+		showstatus (engine);
+		drawboard (engine);
+		showattrs ();
 		out_refresh ();
+		/* Level cleared, hold everything still for a moment */
+		if (session.show_cleared)
+		  {
+			 ch = in_getch ();
+			 if (ch == 'q' || ch == 'Q') finished = TRUE;
+			 else if (ch == IN_ALARM) showhint ();
+			 else if (ch == ERR)
+			   {
+				  session.show_cleared = FALSE;
+				  in_timeout (gravity);
+			   }
+			 continue;
+		  }
 		/* Check if user pressed a key */
-		if ((ch = in_getch ()) != ERR)
+		if ((ch = in_getch ()) == IN_ALARM)
+		  showhint ();
+		else if (ch != ERR)
 		  {
 			 switch (ch)
 			   {
 				case 'j':
 				case KEY_LEFT:
-				  engine_move (&engine,ACTION_LEFT);
+				  live_event (EVENT_LEFT,0);
 				  break;
 				case 'k':
 				case '\n':
-				  engine_move (&engine,ACTION_ROTATE);
+				  live_event (EVENT_ROTATE,0);
 				  break;
 				case 'l':
 				case KEY_RIGHT:
-				  engine_move (&engine,ACTION_RIGHT);
+				  live_event (EVENT_RIGHT,0);
 				  break;
 				case ' ':
 				case KEY_DOWN:
-				  engine_move (&engine,ACTION_DROP);
+				  live_event (EVENT_DROP,0);
 				  break;
 				  /* show next piece */
 				case 's':
-				  shownext = TRUE;
-				  break;
 				  /* toggle dotted lines */
 				case 'd':
-				  dottedlines = !dottedlines;
+				  live_event (EVENT_OPTION,ch);
 				  break;
 				  /* next level */
 				case 'a':
 				case KEY_UP:
-				  if (engine.level < MAXLEVEL)
-					{
-					   engine.level++;
-					   in_timeout (DELAY);
-					}
-				  else if (engine.game_mode == GAME_ZEN)
-					{
-                                           /* wrap around on zen */
-					   engine.level = MINLEVEL;
-					   in_timeout (DELAY);
-					}
+				  level = engine->level;
+				  live_event (EVENT_LEVEL,0);
+				  if (engine->level != level) in_timeout (gravity = DELAY);
 				  else out_beep ();
 				  break;
 				  /* quit */
@@ -1064,15 +1192,26 @@ int main (int argc,char *argv[])
 				case 'Q':
 				  finished = TRUE;
 				  break;
+				  /* toggle showing where the computer would put it */
+				case 'h':
+				  if (!hintpool && hint_start (0,beam) == OK) hintpool = TRUE;
+				  if (!hintpool) out_beep ();
+				  else if ((hintmode = !hintmode)) askhint (engine);
+				  else
+					{
+					   hinting = FALSE;
+					   hint_cancel ();
+					}
+				  break;
 				  /* pause */
 				case 'p':
-				  engine.pause_start = time(NULL);
+				  engine->pause_start = time(NULL);
 				  out_setcolor (COLOR_WHITE,COLOR_BLACK);
 				  out_gotoxy ((out_width () - 34) / 2,out_height () - 2);
 				  out_printf ("Paused - Press any key to continue");
-				  while ((ch = in_getch ()) == ERR) ;	/* Wait for a key to be pressed */
-				  engine.pause_end = time(NULL);
-				  engine.accumulated_pause += engine.pause_end - engine.pause_start;
+				  ch = in_wait ();						/* Wait for a key to be pressed */
+				  engine->pause_end = time(NULL);
+				  live_event (EVENT_PAUSE,engine->pause_end - engine->pause_start);
 				  in_flush ();							/* Clear keyboard buffer */
 				  out_gotoxy ((out_width () - 34) / 2,out_height () - 2);
 				  out_printf ("                                  ");
@@ -1085,24 +1224,32 @@ int main (int argc,char *argv[])
 		  }
 		else
 		  {
-			 switch (engine_evaluate (&engine))
+			 if (autoplay)
+			   {
+				  autoplay_keys (engine,fresh);
+				  fresh = FALSE;
+			   }
+			 level = engine->level;
+			 switch (live_event (EVENT_TICK,0))
 			   {
 				  /* game over (board full) */
 				case -1:
-				  if ((engine.level < MAXLEVEL) && ((engine.status.droppedlines / 10) > engine.level)) engine.level++;
 				  finished = TRUE;
 				  break;
 				  /* shape at bottom, next one released */
 				case 0:
-				  if ((engine.level < MAXLEVEL) &&
-				      ((engine.status.droppedlines / 10) > engine.level) &&
-				      (engine.game_mode != GAME_CHALLENGE) &&
-				      (engine.game_mode != GAME_ZEN))
+				  fresh = TRUE;
+				  hinting = FALSE;
+				  if (hintmode) askhint (engine);
+				  if (engine->level_cleared)
 					{
-					   engine.level++;
-					   in_timeout (DELAY);
+					   engine->level_cleared = FALSE;
+					   session.show_cleared = TRUE;
+					   in_timeout (CLEARED_DELAY);
 					}
-				  shapecount[engine.curshape]++;
+				  /* a challenge clear goes up a level but keeps its own speed */
+				  else if (engine->level != level && engine->game_mode != GAME_CHALLENGE)
+					in_timeout (gravity = DELAY);
 				  break;
 				  /* shape moved down one line */
 				case 1:
@@ -1113,13 +1260,26 @@ int main (int argc,char *argv[])
    while (!finished);
    /* Restore console settings and exit */
    io_close ();
+   if (recording && replay_close (&recorder) != OK)
+	fprintf (stderr,"Error writing replay to %s\n",record_file);
+   if (autoplay && search.searches > 0)
+	 fprintf (stderr,"The computer weighed %lld boards in %lld searches, %.0f a second\n",
+			  search.searched,search.searches,search.usec ? search.searched / (search.usec / 1e6) : 0.0);
+   if (searching) ai_search_free (&search);
+   if (hintpool)
+	 {
+		hint_report (stderr);
+		hint_stop ();
+	 }
+   /* the computer's games aren't the player's */
+   if (!autoplay) savehistory (engine,now_ms () - session.start_ms);
    /* Don't bother the player if he want's to quit */
    if (ch != 'q' && ch != 'Q')
-	showplayerstats (&engine);
+	showplayerstats (engine);
    else
 	quiet_scores = TRUE;
 
-   savescores (GETSCORE (engine.score));
+   if (!autoplay) savescores (GETSCORE (engine->score));
    exit (EXIT_SUCCESS);
 }
 
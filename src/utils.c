@@ -28,33 +28,37 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <time.h>
 #include <limits.h>
+#include <unistd.h>
 
 #include "typedefs.h"
 #include "basic.h"
+#include "utils.h"
 
 /*
- * Initialize random number generator
+ * Pick a seed for a game nobody asked to repeat
  */
-void rand_init ()
+uint64_t rand_seed ()
 {
-   srandom (time (NULL));
+   return ((uint64_t) time (NULL) << 20) ^ (uint64_t) getpid ();
 }
 
 /*
  * With status < 0: Generate a random number within range
  * Otherwise use status to pick a mostly determinate value.
  */
-int rand_value (int status, int range)
+int rand_value (rng_t *rng, int status, int range)
 {
    if(status < 0) {
-     return (random() % range);
+     return (rng_below (rng, range));
    } else {
      int rc = status % range;
-     int lucky = random() % 100;
+     int lucky = rng_below (rng, 100);
      if(lucky < PERCENT_RAND) {
-       rc = (random () % range);
+       rc = (rng_below (rng, range));
      }
      return(rc);
    }
@@ -63,20 +67,20 @@ int rand_value (int status, int range)
 /*
  * Pick a new value for rand_status
  */
-int update_rs(int old)
+int update_rs(rng_t *rng, int old)
 {
   int use_next;
   if(old < 0) {
     return(old);
   }
 
-  use_next = random();
+  use_next = rng_next (rng) >> 1;
   if ((old % NUMSHAPES) == (use_next % NUMSHAPES)) {
-     int lucky = random() % 100;
+     int lucky = rng_below (rng, 100);
      /* this lucky checks the opposite way from rand_value() lucky */
      if(lucky > PERCENT_RAND) {
        /* pick a new random without checking status mod 7 */
-       use_next = random();
+       use_next = rng_next (rng) >> 1;
      }
     
   }
@@ -107,3 +111,37 @@ char *getenv_with_default (const char *name,char *def)
      return env;
 }
 
+/*
+ * Expand a leading $VARIABLE in path: "$HOME/.notint.scores" becomes
+ * "/home/me/.notint.scores" (or "/.notint.scores" without a HOME).
+ * Returns path itself if there is nothing to expand, or NULL when out
+ * of memory.
+ */
+char *expand_path (char *path)
+{
+    char *envvar, *envname, *expanded;
+    char *c;
+    int size, tmp;
+
+    if (*path != '$') return path;
+    c = path + 1;
+    while ( *c  && (*c == '_' || isalnum(tmp = *c)) ) c++;
+    /* Now c is either \0 or the first post-envname character, so
+     * either way size will be one longer than name.
+     */
+    size = c - path;
+    envname = (char*)malloc(size);
+    if (envname == NULL) return NULL;
+    strncpy (envname, path + 1, size);
+    envname[size -1] = '\0';
+    envvar = getenv(envname);
+    free (envname);
+    if (envvar == NULL) return c;
+    size = strlen(envvar) + strlen(c) + 1;
+    expanded = (char*)malloc(size);
+    if (expanded == NULL) return NULL;
+    strcpy (expanded, envvar);
+    strcat (expanded, c);
+    expanded[size -1] = '\0';
+    return expanded;
+}
@@ -30,21 +30,22 @@
  */
 
 #include "typedefs.h"
+#include "rng.h"
 
 /*
- * Initialize random number generator
+ * Pick a seed for a game (time and process based)
  */
-void rand_init ();
+uint64_t rand_seed ();
 
 /*
  * Generate a random number within range
  */
-int rand_value (int status, int range);
+int rand_value (rng_t *rng, int status, int range);
 
 /*
  * Pick a new value for rand_status
  */
-int update_rs (int old);
+int update_rs (rng_t *rng, int old);
 
 /*
  * Convert an str to long. Returns TRUE if successful,
@@ -57,4 +58,10 @@ bool str2int (int *i,const char *str);
  */
 char *getenv_with_default (const char *name,char *def);
 
+/*
+ * Expand a leading $VARIABLE in path. Returns path itself if there is
+ * nothing to expand, or NULL when out of memory.
+ */
+char *expand_path (char *path);
+
 #endif	/* #ifndef UTILS_H */
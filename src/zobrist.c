@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "typedefs.h"
+#include "basic.h"
+#include "rng.h"
+#include "engine.h"
+#include "zobrist.h"
+
+/* Where the keys come from: any fixed seed will do */
+#define ZOBRIST_SEED	0x6e6f74696e74ULL
+
+/*
+ * Global variables
+ */
+
+uint64_t zobrist_keys[NUMROWS][NUMCOLS];
+uint64_t zobrist_curshape[NUMSHAPES];
+uint64_t zobrist_nextshape[NUMSHAPES];
+static uint64_t status_key;
+static bool ready = FALSE;
+
+/*
+ * Functions
+ */
+
+/* 64 random bits */
+static uint64_t newkey (rng_t *rng)
+{
+   uint64_t key = (uint64_t) rng_next (rng) << 32;
+   return key | rng_next (rng);
+}
+
+void zobrist_init ()
+{
+   rng_t rng;
+   int i,x,y;
+   if (ready) return;
+   rng_seed (&rng,ZOBRIST_SEED);
+   for (y = 0; y < NUMROWS; y++)
+	 for (x = 0; x < NUMCOLS; x++)
+	   zobrist_keys[y][x] = newkey (&rng);
+   for (i = 0; i < NUMSHAPES; i++) zobrist_curshape[i] = newkey (&rng);
+   for (i = 0; i < NUMSHAPES; i++) zobrist_nextshape[i] = newkey (&rng);
+   status_key = newkey (&rng);
+   ready = TRUE;
+}
+
+uint64_t zobrist_rows (const row_t rows[NUMROWS])
+{
+   uint64_t hash = 0;
+   row_t row;
+   int y;
+   for (y = 0; y < NUMROWS - 2; y++)
+	 for (row = rows[y] & PLAYFIELD_ROW; row; row &= row - 1)
+	   hash ^= zobrist_keys[y][lowbit (row)];
+   return hash;
+}
+
+uint64_t zobrist_status (int rand_status)
+{
+   /* splitmix64's finisher, so states that differ by a bit get unrelated keys */
+   uint64_t key = status_key + (uint32_t) rand_status * 0x9e3779b97f4a7c15ULL;
+   key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+   return key ^ (key >> 31);
+}
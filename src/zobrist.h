@@ -0,0 +1,79 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+/*
+ * Copyright (c) Abraham vd Merwe <abz@blio.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of other contributors
+ *	  may be used to endorse or promote products derived from this software
+ *	  without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+#include "basic.h"
+#include "engine.h"		/* row_t */
+
+/*
+ * Zobrist hashing of boards: every cell of the playfield has a random
+ * 64-bit key, and a board's hash is the XOR of the keys of its filled
+ * cells. Equal boards hash the same wherever they came from, and a
+ * block going in or out just XORs its key. The rest of a game's
+ * position (see engine_hash ()) has keys of its own, XORed in the same
+ * way.
+ */
+
+/*
+ * Global variables
+ */
+
+/* A key for every cell, by row and column */
+extern uint64_t zobrist_keys[NUMROWS][NUMCOLS];
+
+/* Keys for the falling shape and the next one, by shape number */
+extern uint64_t zobrist_curshape[NUMSHAPES];
+extern uint64_t zobrist_nextshape[NUMSHAPES];
+
+/*
+ * Functions
+ */
+
+/*
+ * Fill in the keys (always the same ones). Does nothing after the
+ * first call; threaded programs should call it before starting any
+ * threads.
+ */
+void zobrist_init ();
+
+/*
+ * Hash the playfield of a board's rows (walls are left out)
+ */
+uint64_t zobrist_rows (const row_t rows[NUMROWS]);
+
+/*
+ * The key for a shape picker state (engine_t's rand_status), which
+ * takes too many values to have a table of keys
+ */
+uint64_t zobrist_status (int rand_status);
+
+#endif	/* #ifndef ZOBRIST_H */